@@ -1,21 +1,133 @@
 #include "ball_camera.h"
+#include "trace_ball_camera.h"
 #include "yushi_ball_camera.h"
 
-BallCamera::BallCamera(std::string addr, uint64_t id)
+#include <glog/logging.h>
+#include <net/EventLoop.h>
+#include <net/EventLoopThread.h>
+
+#include <cmath>
+
+BallCamera::BallCamera(std::string addr, uint64_t id, BallCameraCapability capability)
     : addr_(std::move(addr))
     , id_(id)
+    , capability_(capability)
+    , breaker_(addr_)
+    , executor_thread_(new afl::net::EventLoopThread)
 {
+    executor_ = &executor_thread_->startLoop();
 }
 
+BallCamera::~BallCamera() = default;
+
 std::string BallCamera::get_addr()
 {
     return addr_;
 }
 
+const BallCameraCapability& BallCamera::capability() const
+{
+    return capability_;
+}
+
+void BallCamera::actual_speed(double&, double&)
+{
+}
+
+std::string BallCamera::health()
+{
+    return breaker_.state_name();
+}
+
+bool BallCamera::guarded(const char* what, const std::function<bool()>& call)
+{
+    if (!breaker_.allow()) {
+        VLOG(1) << addr_ << " circuit open, skip " << what;
+        return false;
+    }
+
+    bool ok = call();
+    breaker_.record(ok);
+    return ok;
+}
+
+std::future<bool> BallCamera::submit(std::function<bool()> task)
+{
+    auto pt = std::make_shared<std::packaged_task<bool()>>(std::move(task));
+    auto fut = pt->get_future();
+    ++queued_;
+    executor_->runInLoop([this, pt]() {
+        --queued_;
+        (*pt)();
+    });
+    return fut;
+}
+
+int BallCamera::queued() const
+{
+    return queued_;
+}
+
+std::future<bool> BallCamera::async_get_ptz(PtzCallback cb)
+{
+    return submit([this, cb]() {
+        double p = NAN, t = NAN, z = NAN;
+        bool ok = get_ptz(p, t, z);
+        if (cb) {
+            cb(ok, p, t, z);
+        }
+        return ok;
+    });
+}
+
+std::future<bool> BallCamera::async_set_ptz(double p, double t, double z, DoneCallback cb)
+{
+    return submit([this, p, t, z, cb]() {
+        bool ok = set_ptz(p, t, z);
+        if (cb) {
+            cb(ok);
+        }
+        return ok;
+    });
+}
+
+std::future<bool> BallCamera::async_go_to_preset(uint64_t preset_id, DoneCallback cb)
+{
+    return submit([this, preset_id, cb]() {
+        bool ok = go_to_preset(preset_id);
+        if (cb) {
+            cb(ok);
+        }
+        return ok;
+    });
+}
+
+std::future<bool> BallCamera::async_snapshot(SnapshotCallback cb)
+{
+    return submit([this, cb]() {
+        std::string pic;
+        bool ok = snapshot(pic);
+        if (cb) {
+            cb(ok, pic);
+        }
+        return ok;
+    });
+}
+
 std::shared_ptr<BallCamera> get_ball_camera(const std::string& brand, const std::string& addr, const uint64_t& id)
 {
+    BallCameraCapability capability;
     if (brand == "YuShi") {
-        return std::make_shared<YuShiBallCamera>(addr, id);
+        return std::make_shared<YuShiBallCamera>(addr, id, capability);
+    }
+    // Firmware whose AbsoluteMove also takes ZoomRatio.
+    if (brand == "YuShiPTZ") {
+        capability.combined_ptz = true;
+        return std::make_shared<YuShiBallCamera>(addr, id, capability);
+    }
+    // No camera behind it, used by the replay tool.
+    if (brand == "Trace") {
+        return std::make_shared<TraceBallCamera>(addr, id, capability);
     }
     return nullptr;
-}
\ No newline at end of file
+}
@@ -1,24 +1,74 @@
 #ifndef BALL_CAMERA_H
 #define BALL_CAMERA_H
 
+#include "circuit_breaker.h"
+
 #include <base/Noncopyable.h>
+#include <atomic>
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
+
+namespace afl {
+namespace net {
+    class EventLoop;
+    class EventLoopThread;
+}
+}
+
+struct BallCameraCapability {
+    // The brand takes pan, tilt and zoom in one request instead of a move and a zoom.
+    bool combined_ptz = false;
+};
+
+using PtzCallback = std::function<void(bool ok, double p, double t, double z)>;
+using DoneCallback = std::function<void(bool ok)>;
+using SnapshotCallback = std::function<void(bool ok, std::string& pic)>;
+
 class BallCamera : public afl::Noncopyable {
 public:
-    BallCamera(std::string addr, uint64_t id);
+    BallCamera(std::string addr, uint64_t id, BallCameraCapability capability = BallCameraCapability());
+    virtual ~BallCamera();
 
     virtual bool get_ptz(double& p, double& t, double& z) = 0;
     virtual bool set_ptz(double p, double t, double z) = 0;
     virtual bool go_to_preset(const uint64_t& preset_id) = 0;
     virtual bool snapshot(std::string& pic) = 0;
+    // Pan/tilt at the given rates in degree/s until the next command, (0, 0) stops.
+    virtual bool continuous_move(double pan_speed, double tilt_speed) = 0;
+    // The rates continuous_move really runs at for the requested ones, after the camera's speed steps.
+    virtual void actual_speed(double& pan_speed, double& tilt_speed);
+
+    // Non-blocking versions, run one after another on the camera's own executor.
+    // The callback is invoked on the executor thread once the camera has answered.
+    std::future<bool> async_get_ptz(PtzCallback cb = nullptr);
+    std::future<bool> async_set_ptz(double p, double t, double z, DoneCallback cb = nullptr);
+    std::future<bool> async_go_to_preset(uint64_t preset_id, DoneCallback cb = nullptr);
+    std::future<bool> async_snapshot(SnapshotCallback cb = nullptr);
+
+    std::future<bool> submit(std::function<bool()> task);
+    // Tasks submitted but not started yet.
+    int queued() const;
 
     std::string get_addr();
+    const BallCameraCapability& capability() const;
+    std::string health();
 
 protected:
+    // Runs a camera call through the circuit breaker, failing fast while it is open.
+    bool guarded(const char* what, const std::function<bool()>& call);
+
     std::string addr_;
     uint64_t id_;
+    BallCameraCapability capability_;
+    CircuitBreaker breaker_;
+
+private:
+    std::unique_ptr<afl::net::EventLoopThread> executor_thread_;
+    afl::net::EventLoop* executor_;
+    std::atomic<int> queued_ { 0 };
 };
 
 std::shared_ptr<BallCamera> get_ball_camera(const std::string& brane, const std::string& addr, const uint64_t& id);
-#endif // BALL_CAMERA_H
\ No newline at end of file
+#endif // BALL_CAMERA_H
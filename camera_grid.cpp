@@ -0,0 +1,61 @@
+#include "camera_grid.h"
+
+#include <cmath>
+
+CameraGrid::CameraGrid(double cell_size)
+    : cell_size_(cell_size)
+{
+}
+
+int64_t CameraGrid::cell(double v) const
+{
+    return static_cast<int64_t>(std::floor(v / cell_size_));
+}
+
+uint64_t CameraGrid::key(int64_t cx, int64_t cy)
+{
+    return (static_cast<uint64_t>(cx) << 32) ^ static_cast<uint32_t>(cy);
+}
+
+void CameraGrid::add(uint32_t camera, double x, double y, double radius)
+{
+    if (areas_.size() <= camera) {
+        areas_.resize(camera + 1, Area { 0, 0, -1 });
+    }
+    areas_[camera] = Area { x, y, radius };
+
+    for (int64_t cx = cell(x - radius); cx <= cell(x + radius); ++cx) {
+        for (int64_t cy = cell(y - radius); cy <= cell(y + radius); ++cy) {
+            cells_[key(cx, cy)].push_back(camera);
+        }
+    }
+}
+
+void CameraGrid::route(const ParticipantFrame& frame, std::vector<std::vector<uint32_t>>& routed) const
+{
+    routed.resize(areas_.size());
+    for (auto& r : routed) {
+        r.clear();
+    }
+
+    for (size_t i = 0; i < frame.size(); ++i) {
+        auto iter = cells_.find(key(cell(frame.x[i]), cell(frame.y[i])));
+        if (iter == cells_.end()) {
+            continue;
+        }
+
+        for (auto camera : iter->second) {
+            const auto& area = areas_[camera];
+            const double dx = frame.x[i] - area.x;
+            const double dy = frame.y[i] - area.y;
+            if (dx * dx + dy * dy <= area.radius * area.radius) {
+                routed[camera].push_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+}
+
+size_t CameraGrid::cameras() const
+{
+    return areas_.size();
+}
@@ -0,0 +1,45 @@
+#ifndef CAMERA_GRID_H
+#define CAMERA_GRID_H
+
+#include "participant_frame.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Uniform grid over UTM space mapping each cell to the cameras covering it.
+ *
+ * A camera is entered into every cell its coverage circle touches. Routing a frame
+ * looks up each participant's cell and checks the exact distance only against the
+ * few cameras found there, so the work grows with local density instead of with
+ * cameras x participants.
+ */
+class CameraGrid {
+public:
+    explicit CameraGrid(double cell_size);
+
+    void add(uint32_t camera, double x, double y, double radius);
+
+    // routed[camera] receives the indices of the participants inside that camera's circle.
+    void route(const ParticipantFrame& frame, std::vector<std::vector<uint32_t>>& routed) const;
+
+    size_t cameras() const;
+
+private:
+    struct Area {
+        double x;
+        double y;
+        double radius;
+    };
+
+    int64_t cell(double v) const;
+    static uint64_t key(int64_t cx, int64_t cy);
+
+private:
+    double cell_size_;
+    std::vector<Area> areas_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells_;
+};
+
+#endif // CAMERA_GRID_H
@@ -0,0 +1,518 @@
+/**
+ * @brief A stand-in for YuShi ball cameras, speaking the LAPI subset ptzctl uses.
+ *
+ * Every simulated camera listens on its own localhost port, checks digest auth,
+ * moves with a trapezoidal speed profile on each axis (or at a constant rate under
+ * PTZCtrl continuous moves) and can inject latency, error codes, hangs and dropped
+ * connections.
+ */
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "../httplib.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <nlohmann/json.hpp>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <thread>
+#include <vector>
+
+DEFINE_int32(count, 1, "Number of simulated cameras");
+DEFINE_string(host, "127.0.0.1", "Listen address");
+DEFINE_int32(base_port, 18000, "Camera i listens on base_port + i");
+DEFINE_int32(threads, 2, "Worker threads per camera");
+
+DEFINE_string(user, "admin", "Digest auth user");
+DEFINE_string(password, "Ab123456", "Digest auth password");
+DEFINE_int32(nonce_ttl, 300, "Seconds before a nonce goes stale and the client is challenged again");
+
+DEFINE_double(pan_speed, 120, "Max pan speed, degree/s");
+DEFINE_double(tilt_speed, 60, "Max tilt speed, degree/s");
+DEFINE_double(pt_accel, 240, "Pan/tilt acceleration, degree/s^2");
+DEFINE_double(zoom_speed, 6, "Max zoom speed, ratio/s");
+DEFINE_double(zoom_accel, 20, "Zoom acceleration, ratio/s^2");
+DEFINE_double(max_zoom, 33, "Max zoom ratio");
+DEFINE_double(speed_per_level, 5.0, "Pan/tilt degree/s of one PTZCtrl speed level");
+
+DEFINE_int32(latency_ms, 5, "Base response latency");
+DEFINE_int32(jitter_ms, 5, "Uniform extra latency in [0, jitter_ms]");
+DEFINE_double(error_rate, 0, "Probability of answering with error_code");
+DEFINE_int32(error_code, 500, "Status code of injected errors");
+DEFINE_double(hang_rate, 0, "Probability of holding a request for hang_ms");
+DEFINE_int32(hang_ms, 10000, "How long a hung request is held");
+DEFINE_double(close_rate, 0, "Probability of dropping the connection mid-request, without a response");
+DEFINE_int32(idle_close_sec, 5, "Keep-alive connections idle this long are closed");
+DEFINE_int32(snapshot_size, 200 * 1024, "Bytes of a snapshot");
+
+namespace {
+
+int port_of(const sockaddr_storage& addr)
+{
+    if (addr.ss_family == AF_INET) {
+        return ntohs(reinterpret_cast<const sockaddr_in&>(addr).sin_port);
+    }
+    if (addr.ss_family == AF_INET6) {
+        return ntohs(reinterpret_cast<const sockaddr_in6&>(addr).sin6_port);
+    }
+    return -1;
+}
+
+// The accepted socket serving a request, found by its two ports; httplib does not
+// hand it to handlers. -1 if there is none.
+int find_socket(int local_port, int remote_port)
+{
+    DIR* dir = opendir("/proc/self/fd");
+    if (dir == nullptr) {
+        return -1;
+    }
+
+    int found = -1;
+    for (struct dirent* entry = readdir(dir); entry != nullptr && found < 0; entry = readdir(dir)) {
+        char* end = nullptr;
+        const long fd = std::strtol(entry->d_name, &end, 10);
+        if (end == entry->d_name || *end != '\0' || fd == dirfd(dir)) {
+            continue;
+        }
+
+        sockaddr_storage local, remote;
+        socklen_t local_len = sizeof(local), remote_len = sizeof(remote);
+        if (getsockname(fd, reinterpret_cast<sockaddr*>(&local), &local_len) == 0
+            && getpeername(fd, reinterpret_cast<sockaddr*>(&remote), &remote_len) == 0
+            && port_of(local) == local_port && port_of(remote) == remote_port) {
+            found = static_cast<int>(fd);
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+double now_sec()
+{
+    using namespace std::chrono;
+    return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Distance covered after t seconds of a move of length dist with a trapezoidal speed profile.
+double travelled(double dist, double vmax, double acc, double t)
+{
+    const double t_acc = vmax / acc;
+    const double d_acc = 0.5 * acc * t_acc * t_acc;
+
+    if (dist < 2 * d_acc) {
+        const double t_half = std::sqrt(dist / acc);
+        if (t < t_half) {
+            return 0.5 * acc * t * t;
+        }
+        if (t < 2 * t_half) {
+            const double r = 2 * t_half - t;
+            return dist - 0.5 * acc * r * r;
+        }
+        return dist;
+    }
+
+    const double t_cruise = (dist - 2 * d_acc) / vmax;
+    if (t < t_acc) {
+        return 0.5 * acc * t * t;
+    }
+    if (t < t_acc + t_cruise) {
+        return d_acc + vmax * (t - t_acc);
+    }
+    if (t < 2 * t_acc + t_cruise) {
+        const double r = 2 * t_acc + t_cruise - t;
+        return dist - 0.5 * acc * r * r;
+    }
+    return dist;
+}
+
+struct Axis {
+    double start = 0;
+    double target = 0;
+    double t0 = 0;
+    double vmax = 1;
+    double acc = 1;
+    bool wrap = false;
+    double velocity = 0; // continuous move when not 0
+
+    double delta() const
+    {
+        return wrap ? std::remainder(target - start, 360.0) : target - start;
+    }
+
+    double at(double now) const
+    {
+        const double d = delta();
+        double pos = (velocity != 0) ? start + velocity * (now - t0)
+                                     : start + std::copysign(travelled(std::fabs(d), vmax, acc, now - t0), d);
+        if (wrap) {
+            pos = std::fmod(pos + 360.0, 360.0);
+        }
+        return pos;
+    }
+
+    void move_to(double pos, double now)
+    {
+        start = at(now);
+        target = pos;
+        t0 = now;
+        velocity = 0;
+    }
+
+    void move_at(double speed, double now)
+    {
+        start = target = at(now);
+        t0 = now;
+        velocity = std::max(-vmax, std::min(speed, vmax));
+    }
+};
+
+class SimCamera {
+public:
+    SimCamera(int index, int port)
+        : index_(index)
+        , port_(port)
+        , rng_(std::random_device()())
+    {
+        pan_.vmax = FLAGS_pan_speed;
+        pan_.acc = FLAGS_pt_accel;
+        pan_.wrap = true;
+        tilt_.vmax = FLAGS_tilt_speed;
+        tilt_.acc = FLAGS_pt_accel;
+        zoom_.vmax = FLAGS_zoom_speed;
+        zoom_.acc = FLAGS_zoom_accel;
+        zoom_.start = zoom_.target = 1;
+
+        new_nonce();
+        setup();
+    }
+
+    bool start()
+    {
+        if (!svr_.bind_to_port(FLAGS_host.c_str(), port_)) {
+            LOG(ERROR) << "camera " << index_ << " bind " << port_ << " failed";
+            return false;
+        }
+        thread_ = std::thread([this]() { svr_.listen_after_bind(); });
+        return true;
+    }
+
+    void join()
+    {
+        thread_.join();
+    }
+
+    nlohmann::json stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const double now = now_sec();
+        return nlohmann::json {
+            { "port", port_ },
+            { "requests", requests_.load() },
+            { "challenges", challenges_.load() },
+            { "injected_errors", errors_.load() },
+            { "dropped", dropped_.load() },
+            { "p", pan_.at(now) },
+            { "t", tilt_.at(now) },
+            { "z", zoom_.at(now) }
+        };
+    }
+
+private:
+    void new_nonce()
+    {
+        nonce_ = httplib::detail::random_string(32);
+        nonce_time_ = now_sec();
+    }
+
+    bool chance(double rate)
+    {
+        std::lock_guard<std::mutex> lock(rng_mutex_);
+        return rate > 0 && std::uniform_real_distribution<double>(0, 1)(rng_) < rate;
+    }
+
+    int jitter()
+    {
+        std::lock_guard<std::mutex> lock(rng_mutex_);
+        return FLAGS_jitter_ms > 0 ? std::uniform_int_distribution<int>(0, FLAGS_jitter_ms)(rng_) : 0;
+    }
+
+    void challenge(httplib::Response& res, bool stale)
+    {
+        ++challenges_;
+        res.status = 401;
+        res.set_header("WWW-Authenticate",
+            "Digest realm=\"" + realm_ + "\", nonce=\"" + nonce_ + "\", qop=\"auth\"" + (stale ? ", stale=true" : ""));
+    }
+
+    bool authorized(const httplib::Request& req, httplib::Response& res)
+    {
+        static const std::regex re(R"~((\w+)=(?:"([^"]*)"|([^,\s]*)))~");
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (now_sec() - nonce_time_ > FLAGS_nonce_ttl) {
+            new_nonce();
+        }
+
+        const auto header = req.get_header_value("Authorization");
+        if (header.compare(0, 7, "Digest ") != 0) {
+            challenge(res, false);
+            return false;
+        }
+
+        std::map<std::string, std::string> auth;
+        for (auto it = std::sregex_iterator(header.begin() + 7, header.end(), re); it != std::sregex_iterator(); ++it) {
+            auth[(*it)[1]] = (*it)[2].matched ? (*it)[2].str() : (*it)[3].str();
+        }
+
+        if (auth["nonce"] != nonce_) {
+            challenge(res, true);
+            return false;
+        }
+
+        const auto ha1 = httplib::detail::MD5(FLAGS_user + ":" + realm_ + ":" + FLAGS_password);
+        const auto ha2 = httplib::detail::MD5(req.method + ":" + auth["uri"]);
+        const auto expected = httplib::detail::MD5(
+            ha1 + ":" + nonce_ + ":" + auth["nc"] + ":" + auth["cnonce"] + ":" + auth["qop"] + ":" + ha2);
+        if (auth["username"] != FLAGS_user || auth["response"] != expected) {
+            challenge(res, false);
+            return false;
+        }
+        return true;
+    }
+
+    static std::string lapi_response(const std::string& url, const nlohmann::json& data)
+    {
+        nlohmann::json j;
+        j["Response"]["ResponseURL"] = url;
+        j["Response"]["StatusCode"] = 0;
+        j["Response"]["StatusString"] = "Succeed";
+        j["Response"]["Data"] = data;
+        return j.dump();
+    }
+
+    void setup()
+    {
+        svr_.new_task_queue = []() { return new httplib::ThreadPool(FLAGS_threads); };
+        svr_.set_keep_alive_timeout(FLAGS_idle_close_sec);
+        svr_.set_tcp_nodelay(true);
+
+        svr_.set_pre_routing_handler([this](const httplib::Request& req, httplib::Response& res) {
+            ++requests_;
+            std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_latency_ms + jitter()));
+
+            if (chance(FLAGS_close_rate) && drop(req)) {
+                return httplib::Server::HandlerResponse::Handled;
+            }
+            if (chance(FLAGS_hang_rate)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_hang_ms));
+            }
+            if (req.path == "/sim/stats") {
+                return httplib::Server::HandlerResponse::Unhandled;
+            }
+            if (!authorized(req, res)) {
+                return httplib::Server::HandlerResponse::Handled;
+            }
+            if (chance(FLAGS_error_rate)) {
+                ++errors_;
+                res.status = FLAGS_error_code;
+                return httplib::Server::HandlerResponse::Handled;
+            }
+            return httplib::Server::HandlerResponse::Unhandled;
+        });
+
+        const std::string move = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteMove";
+        const std::string zoom = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteZoom";
+
+        svr_.Get(move.c_str(), [this, move](const httplib::Request&, httplib::Response& res) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const double now = now_sec();
+            res.set_content(lapi_response(move, { { "Longitude", pan_.at(now) }, { "Latitude", tilt_.at(now) } }), "application/json");
+        });
+
+        svr_.Get(zoom.c_str(), [this, zoom](const httplib::Request&, httplib::Response& res) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            res.set_content(lapi_response(zoom, { { "ZoomRatio", zoom_.at(now_sec()) } }), "application/json");
+        });
+
+        svr_.Put(move.c_str(), [this, move](const httplib::Request& req, httplib::Response& res) {
+            try {
+                auto body = nlohmann::json::parse(req.body);
+                std::lock_guard<std::mutex> lock(mutex_);
+                const double now = now_sec();
+                pan_.move_to(std::fmod(body["Longitude"].get<double>() + 360.0, 360.0), now);
+                tilt_.move_to(body["Latitude"].get<double>(), now);
+                if (body.contains("ZoomRatio")) {
+                    zoom_.move_to(clamp_zoom(body["ZoomRatio"].get<double>()), now);
+                }
+                res.set_content(lapi_response(move, nullptr), "application/json");
+            } catch (const std::exception&) {
+                res.status = 400;
+            }
+        });
+
+        svr_.Put(zoom.c_str(), [this, zoom](const httplib::Request& req, httplib::Response& res) {
+            try {
+                auto body = nlohmann::json::parse(req.body);
+                std::lock_guard<std::mutex> lock(mutex_);
+                zoom_.move_to(clamp_zoom(body["ZoomRatio"].get<double>()), now_sec());
+                res.set_content(lapi_response(zoom, nullptr), "application/json");
+            } catch (const std::exception&) {
+                res.status = 400;
+            }
+        });
+
+        svr_.Put(R"(/LAPI/V1.0/Channels/0/PTZ/Presets/(\d+)/Goto)", [this](const httplib::Request& req, httplib::Response& res) {
+            const auto id = std::stoul(req.matches[1]);
+            std::lock_guard<std::mutex> lock(mutex_);
+            const double now = now_sec();
+            // Every preset id lands on its own repeatable position.
+            pan_.move_to(std::fmod(id * 37.0 + index_ * 11.0, 360.0), now);
+            tilt_.move_to(5.0 + std::fmod(id * 7.0, 40.0), now);
+            zoom_.move_to(1.0 + std::fmod(id * 3.0, 10.0), now);
+            res.set_content(lapi_response(req.path, nullptr), "application/json");
+        });
+
+        svr_.Put("/LAPI/V1.0/Channels/0/PTZ/PTZCtrl", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                auto body = nlohmann::json::parse(req.body);
+                const int cmd = body["PTZCmd"];
+                const double pan = body.value("Para1", 0) * FLAGS_speed_per_level;
+                const double tilt = body.value("Para2", 0) * FLAGS_speed_per_level;
+
+                // Direction of each command as (pan, tilt) signs, a positive tilt looks further down.
+                int sp = 0, st = 0;
+                switch (cmd) {
+                case 0x0402:
+                    st = -1;
+                    break;
+                case 0x0404:
+                    st = 1;
+                    break;
+                case 0x0502:
+                    sp = 1;
+                    break;
+                case 0x0504:
+                    sp = -1;
+                    break;
+                case 0x0702:
+                    sp = -1;
+                    st = -1;
+                    break;
+                case 0x0704:
+                    sp = -1;
+                    st = 1;
+                    break;
+                case 0x0802:
+                    sp = 1;
+                    st = -1;
+                    break;
+                case 0x0804:
+                    sp = 1;
+                    st = 1;
+                    break;
+                case 0x0901:
+                    break;
+                default:
+                    res.status = 400;
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                const double now = now_sec();
+                pan_.move_at(sp * pan, now);
+                tilt_.move_at(st * tilt, now);
+                res.set_content(lapi_response(req.path, nullptr), "application/json");
+            } catch (const std::exception&) {
+                res.status = 400;
+            }
+        });
+
+        svr_.Get("/LAPI/V1.0/Channels/0/Media/Video/Streams/0/Snapshot", [](const httplib::Request&, httplib::Response& res) {
+            std::string pic(std::max(FLAGS_snapshot_size, 4), '\0');
+            pic[0] = '\xFF';
+            pic[1] = '\xD8';
+            pic[pic.size() - 2] = '\xFF';
+            pic[pic.size() - 1] = '\xD9';
+            res.set_content(pic, "image/jpeg");
+        });
+
+        svr_.Get("/sim/stats", [this](const httplib::Request&, httplib::Response& res) {
+            res.set_content(stats().dump(), "application/json");
+        });
+    }
+
+    // Shuts the request's connection down before anything is written, so the client
+    // sees it drop mid-request, like a camera dropping a reused keep-alive connection.
+    bool drop(const httplib::Request& req)
+    {
+        const int fd = find_socket(port_, req.remote_port);
+        if (fd < 0 || shutdown(fd, SHUT_RDWR) != 0) {
+            return false;
+        }
+        ++dropped_;
+        return true;
+    }
+
+    static double clamp_zoom(double z)
+    {
+        return std::min(std::max(z, 1.0), FLAGS_max_zoom);
+    }
+
+private:
+    int index_;
+    int port_;
+
+    httplib::Server svr_;
+    std::thread thread_;
+
+    std::mutex mutex_;
+    Axis pan_;
+    Axis tilt_;
+    Axis zoom_;
+    std::string realm_ = "LAPI";
+    std::string nonce_;
+    double nonce_time_ = 0;
+
+    std::mutex rng_mutex_;
+    std::mt19937 rng_;
+
+    std::atomic<uint64_t> requests_ { 0 };
+    std::atomic<uint64_t> challenges_ { 0 };
+    std::atomic<uint64_t> errors_ { 0 };
+    std::atomic<uint64_t> dropped_ { 0 };
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+
+    std::vector<std::unique_ptr<SimCamera>> cameras;
+    for (int i = 0; i < FLAGS_count; ++i) {
+        std::unique_ptr<SimCamera> cam(new SimCamera(i, FLAGS_base_port + i));
+        if (!cam->start()) {
+            return -1;
+        }
+        cameras.emplace_back(std::move(cam));
+    }
+    LOG(INFO) << FLAGS_count << " cameras listening on " << FLAGS_host << ":" << FLAGS_base_port
+              << "-" << FLAGS_base_port + FLAGS_count - 1;
+
+    for (auto& cam : cameras) {
+        cam->join();
+    }
+    return 0;
+}
@@ -0,0 +1,276 @@
+#include "capture_file.h"
+
+#include <glog/logging.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+namespace capture {
+
+namespace {
+
+    const char MAGIC[8] = { 'Z', 'C', 'A', 'P', '0', '0', '0', '1' };
+
+    size_t padded(size_t n)
+    {
+        return (n + 7) & ~static_cast<size_t>(7);
+    }
+
+    std::string start_time()
+    {
+        char buf[32];
+        std::time_t now = std::time(nullptr);
+        std::tm tm;
+        localtime_r(&now, &tm);
+        std::strftime(buf, sizeof(buf), "%Y%m%d_%H%M%S", &tm);
+        return buf;
+    }
+
+} // namespace
+
+Recorder::Recorder(const std::string& dir, size_t segment_bytes)
+    : dir_(dir)
+    , prefix_(dir + "/capture_" + start_time() + "_")
+    , segment_bytes_(std::max(padded(segment_bytes), sizeof(SegmentHeader) + sizeof(RecordHeader)))
+{
+    current_ = open_segment(seq_);
+    next_ = std::async(std::launch::async, [this]() { return open_segment(1); });
+}
+
+Recorder::~Recorder()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    close_segment(current_);
+
+    // The spare segment never got a record.
+    Segment spare = next_.get();
+    if (spare.base != nullptr) {
+        munmap(spare.base, spare.capacity);
+        close(spare.fd);
+        unlink(spare.path.c_str());
+    }
+}
+
+Recorder::Segment Recorder::open_segment(uint64_t seq) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%06llu.zcap", static_cast<unsigned long long>(seq));
+
+    Segment segment;
+    segment.path = prefix_ + name;
+    segment.fd = open(segment.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (segment.fd < 0 || ftruncate(segment.fd, segment_bytes_) != 0) {
+        PLOG(ERROR) << "create capture segment " << segment.path << " failed";
+        if (segment.fd >= 0) {
+            close(segment.fd);
+        }
+        return Segment();
+    }
+
+    void* base = mmap(nullptr, segment_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fd, 0);
+    if (base == MAP_FAILED) {
+        PLOG(ERROR) << "mmap capture segment " << segment.path << " failed";
+        close(segment.fd);
+        return Segment();
+    }
+
+    segment.base = static_cast<char*>(base);
+    segment.capacity = segment_bytes_;
+
+    // Dirty every page here, on the helper thread, so appends take no page faults.
+    const long page = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < segment.capacity; offset += page) {
+        segment.base[offset] = 0;
+    }
+
+    SegmentHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.reserved = 0;
+    std::memcpy(segment.base, &header, sizeof(header));
+    segment.used = sizeof(header);
+    return segment;
+}
+
+void Recorder::close_segment(Segment segment)
+{
+    if (segment.base == nullptr) {
+        return;
+    }
+
+    munmap(segment.base, segment.capacity);
+    // Keep one zeroed RecordHeader as the end marker when there is room for it.
+    const size_t length = std::min(segment.capacity, segment.used + sizeof(RecordHeader));
+    LOG_IF(ERROR, ftruncate(segment.fd, length) != 0) << "trim capture segment " << segment.path << " failed";
+    close(segment.fd);
+    LOG(INFO) << "capture segment " << segment.path << " closed, " << segment.used << " bytes";
+}
+
+void Recorder::rotate()
+{
+    Segment full = current_;
+    current_ = next_.get();
+    ++seq_;
+
+    const uint64_t seq = seq_ + 1;
+    next_ = std::async(std::launch::async, [this, full, seq]() {
+        close_segment(full);
+        return open_segment(seq);
+    });
+}
+
+void Recorder::append(const char* topic, size_t topic_size, const char* payload, size_t payload_size, uint16_t source)
+{
+    const int64_t monotonic_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+                                     .count();
+    const int64_t wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch())
+                                .count();
+    const size_t bytes = sizeof(RecordHeader) + padded(topic_size + payload_size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (0 == topic_size || topic_size > UINT16_MAX || payload_size > UINT32_MAX) {
+        ++dropped_;
+        return;
+    }
+
+    if (current_.base == nullptr || current_.used + bytes > current_.capacity) {
+        if (sizeof(SegmentHeader) + bytes > segment_bytes_) {
+            ++dropped_;
+            return;
+        }
+        rotate();
+        if (current_.base == nullptr) {
+            ++dropped_;
+            return;
+        }
+    }
+
+    char* p = current_.base + current_.used;
+    std::memcpy(p + sizeof(RecordHeader), topic, topic_size);
+    std::memcpy(p + sizeof(RecordHeader) + topic_size, payload, payload_size);
+
+    // The header goes last, so a crash mid-copy leaves a zero topic size: the end marker.
+    RecordHeader header;
+    header.size = static_cast<uint32_t>(payload_size);
+    header.topic_size = static_cast<uint16_t>(topic_size);
+    header.source = source;
+    header.monotonic_ns = monotonic_ns;
+    header.wall_us = wall_us;
+    std::memcpy(p, &header, sizeof(header));
+
+    current_.used += bytes;
+    ++records_;
+}
+
+uint64_t Recorder::records() const
+{
+    return records_;
+}
+
+uint64_t Recorder::dropped() const
+{
+    return dropped_;
+}
+
+Reader::Reader(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path.c_str());
+        for (struct dirent* entry = dir ? readdir(dir) : nullptr; entry != nullptr; entry = readdir(dir)) {
+            const std::string name = entry->d_name;
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".zcap") == 0) {
+                files_.push_back(path + "/" + name);
+            }
+        }
+        if (dir != nullptr) {
+            closedir(dir);
+        }
+        std::sort(files_.begin(), files_.end());
+    } else {
+        files_.push_back(path);
+    }
+}
+
+Reader::~Reader()
+{
+    unmap();
+}
+
+void Reader::unmap()
+{
+    if (base_ != nullptr) {
+        munmap(const_cast<char*>(base_), size_);
+        base_ = nullptr;
+    }
+}
+
+bool Reader::open_next_file()
+{
+    unmap();
+    while (file_ < files_.size()) {
+        const std::string& path = files_[file_++];
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SegmentHeader)) {
+            LOG(ERROR) << "skip unreadable capture segment " << path;
+            if (fd >= 0) {
+                close(fd);
+            }
+            continue;
+        }
+
+        void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED || std::memcmp(base, MAGIC, sizeof(MAGIC)) != 0) {
+            LOG(ERROR) << "skip invalid capture segment " << path;
+            if (base != MAP_FAILED) {
+                munmap(base, st.st_size);
+            }
+            continue;
+        }
+
+        base_ = static_cast<const char*>(base);
+        size_ = st.st_size;
+        offset_ = sizeof(SegmentHeader);
+        return true;
+    }
+    return false;
+}
+
+bool Reader::next(Record& record)
+{
+    while (true) {
+        if (base_ != nullptr && offset_ + sizeof(RecordHeader) <= size_) {
+            RecordHeader header;
+            std::memcpy(&header, base_ + offset_, sizeof(header));
+            const size_t body = header.topic_size + static_cast<size_t>(header.size);
+            if (header.topic_size != 0 && offset_ + sizeof(header) + body <= size_) {
+                record.topic = base_ + offset_ + sizeof(header);
+                record.topic_size = header.topic_size;
+                record.payload = record.topic + header.topic_size;
+                record.payload_size = header.size;
+                record.source = header.source;
+                record.monotonic_ns = header.monotonic_ns;
+                record.wall_us = header.wall_us;
+                offset_ += sizeof(header) + padded(body);
+                return true;
+            }
+        }
+
+        if (!open_next_file()) {
+            return false;
+        }
+    }
+}
+
+} // namespace capture
@@ -0,0 +1,116 @@
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Capture files hold raw ZMQ messages as received, one segment file at a time:
+ *
+ *   SegmentHeader, then records until a zero topic size or the end of the file.
+ *   record: RecordHeader, topic bytes, payload bytes, zero padded to 8 bytes.
+ *
+ * Segments are named capture_<start time>_<seq>.zcap, so sorting the names sorts
+ * the records.
+ */
+namespace capture {
+
+struct SegmentHeader {
+    char magic[8]; // "ZCAP0001"
+    uint64_t reserved;
+};
+
+struct RecordHeader {
+    uint32_t size; // payload bytes
+    uint16_t topic_size; // 0 marks the end
+    uint16_t source; // which publisher the message came from, 0 in captures that predate it
+    int64_t monotonic_ns; // steady clock at receive
+    int64_t wall_us; // system clock at receive
+};
+
+/**
+ * @brief Appends messages to memory-mapped segment files.
+ *
+ * An append is a memcpy into the mapping: no syscall and no reserialization. The
+ * next segment is created, sized and pre-faulted on a helper thread while the
+ * current one fills, and the full one is trimmed and closed there too.
+ */
+class Recorder {
+public:
+    Recorder(const std::string& dir, size_t segment_bytes);
+    ~Recorder();
+
+    void append(const char* topic, size_t topic_size, const char* payload, size_t payload_size, uint16_t source);
+
+    uint64_t records() const;
+    uint64_t dropped() const; // larger than a segment, or no segment could be opened
+
+private:
+    struct Segment {
+        int fd = -1;
+        char* base = nullptr;
+        size_t capacity = 0;
+        size_t used = 0;
+        std::string path;
+    };
+
+    Segment open_segment(uint64_t seq) const;
+    static void close_segment(Segment segment);
+    void rotate();
+
+private:
+    std::string dir_;
+    std::string prefix_;
+    size_t segment_bytes_;
+
+    std::mutex mutex_;
+    Segment current_;
+    std::future<Segment> next_;
+    uint64_t seq_ = 0;
+
+    std::atomic<uint64_t> records_ { 0 };
+    std::atomic<uint64_t> dropped_ { 0 };
+};
+
+struct Record {
+    const char* topic;
+    size_t topic_size;
+    const char* payload;
+    size_t payload_size;
+    uint16_t source;
+    int64_t monotonic_ns;
+    int64_t wall_us;
+};
+
+/**
+ * @brief Reads capture segments back in order, without copying the payloads.
+ */
+class Reader {
+public:
+    // path: a segment file, or a directory whose .zcap files are read in name order.
+    explicit Reader(const std::string& path);
+    ~Reader();
+
+    // The record stays valid until the next call.
+    bool next(Record& record);
+
+private:
+    bool open_next_file();
+    void unmap();
+
+private:
+    std::vector<std::string> files_;
+    size_t file_ = 0;
+    const char* base_ = nullptr;
+    size_t size_ = 0;
+    size_t offset_ = 0;
+};
+
+} // namespace capture
+
+#endif // CAPTURE_FILE_H
@@ -0,0 +1,91 @@
+#include "circuit_breaker.h"
+#include "base/Timestamp.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+
+DEFINE_int32(breaker_failures, 3, "Consecutive failed camera calls that open the circuit");
+DEFINE_double(breaker_base_backoff, 1.0, "Seconds the circuit stays open the first time");
+DEFINE_double(breaker_max_backoff, 60.0, "Upper bound of the open time in seconds");
+
+CircuitBreaker::CircuitBreaker(std::string name)
+    : name_(std::move(name))
+    , rng_(std::random_device()())
+{
+}
+
+bool CircuitBreaker::allow()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    switch (state_) {
+    case CLOSED:
+        return true;
+    case OPEN:
+        if (afl::Timestamp::now().microSecondsSinceEpoch() < open_until_) {
+            return false;
+        }
+        state_ = HALF_OPEN;
+        probing_ = true;
+        return true;
+    case HALF_OPEN:
+        // Only one probe at a time.
+        if (probing_) {
+            return false;
+        }
+        probing_ = true;
+        return true;
+    }
+    return false;
+}
+
+void CircuitBreaker::record(bool ok)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    probing_ = false;
+
+    if (ok) {
+        if (state_ != CLOSED) {
+            LOG(INFO) << name_ << " circuit closed";
+        }
+        state_ = CLOSED;
+        failures_ = 0;
+        backoff_ = 0;
+        return;
+    }
+
+    ++failures_;
+    if (state_ == HALF_OPEN || (state_ == CLOSED && failures_ >= FLAGS_breaker_failures)) {
+        open(afl::Timestamp::now().microSecondsSinceEpoch());
+    }
+}
+
+void CircuitBreaker::open(int64_t now)
+{
+    backoff_ = (backoff_ <= 0) ? FLAGS_breaker_base_backoff : std::min(backoff_ * 2, FLAGS_breaker_max_backoff);
+    double wait = backoff_ * std::uniform_real_distribution<double>(0.8, 1.2)(rng_);
+
+    state_ = OPEN;
+    open_until_ = now + static_cast<int64_t>(wait * 1e6);
+    LOG(WARNING) << name_ << " circuit open for " << wait << "s after " << failures_ << " failures";
+}
+
+CircuitBreaker::State CircuitBreaker::state()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+std::string CircuitBreaker::state_name()
+{
+    switch (state()) {
+    case CLOSED:
+        return "closed";
+    case OPEN:
+        return "open";
+    case HALF_OPEN:
+        return "half_open";
+    }
+    return "unknown";
+}
@@ -0,0 +1,48 @@
+#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+
+/**
+ * @brief Per-camera circuit breaker.
+ *
+ * After enough consecutive failures the circuit opens and calls fail fast. Once the
+ * backoff has passed a single probe is let through (half open): success closes the
+ * circuit, failure opens it again with the backoff doubled, plus jitter so a group
+ * of cameras that died together is not probed in lockstep.
+ */
+class CircuitBreaker {
+public:
+    enum State {
+        CLOSED = 0,
+        OPEN,
+        HALF_OPEN
+    };
+
+    explicit CircuitBreaker(std::string name);
+
+    bool allow();
+    void record(bool ok);
+
+    State state();
+    std::string state_name();
+
+private:
+    void open(int64_t now);
+
+private:
+    std::string name_;
+
+    std::mutex mutex_;
+    State state_ = CLOSED;
+    int failures_ = 0;
+    double backoff_ = 0;
+    int64_t open_until_ = 0;
+    bool probing_ = false;
+    std::mt19937 rng_;
+};
+
+#endif // CIRCUIT_BREAKER_H
@@ -0,0 +1,441 @@
+/**
+ * @brief Microbenchmarks of the control hot paths, one JSON object per line.
+ *
+ * Covers target to P/T (PtzController::get_needed_ptz and get_needed_corrected_ptz),
+ * UTM projection (UTMUPS::Forward against the projectors that replaced it), focus
+ * matching (FocusIndex), ControlContext::on_receive_vehicles for M participants over
+ * N cameras, the status JSON of MqttInteractor::send_status and the LAPI parsing of
+ * YuShiBallCamera::get_ptz. Cameras are TraceBallCameras, so nothing leaves the box.
+ *
+ * With --baseline, every result is compared to the same benchmark in an earlier
+ * run's output and the exit code is 1 if any got slower than --tolerance allows.
+ */
+#include "../camera_grid.h"
+#include "../control_context.h"
+#include "../focus_index.h"
+#include "../geo_projector.h"
+#include "../mqtt_interactor.h"
+#include "../participant_frame.h"
+#include "../ptz_controller.h"
+#include "../trace_ball_camera.h"
+#include "../virtual_clock.h"
+#include "../yushi_ball_camera.h"
+#include "../zmq_interactor.h"
+
+#include <GeographicLib/UTMUPS.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <net/EventLoop.h>
+#include <net/EventLoopThread.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+DEFINE_string(filter, "", "Only run benchmarks whose name contains this");
+DEFINE_double(min_time, 0.2, "Seconds each repetition runs for at least");
+DEFINE_int32(repetitions, 5, "Repetitions per benchmark, the median is reported");
+DEFINE_string(participants, "100,300,1000", "Participants per frame for on_receive_vehicles, comma separated");
+DEFINE_string(cameras, "1,8,32", "Cameras for on_receive_vehicles, comma separated");
+DEFINE_double(camera_spacing, 400, "Meters between neighbouring cameras along the road");
+DEFINE_string(baseline, "", "Output of an earlier run to compare against");
+DEFINE_double(tolerance, 0.10, "Allowed slowdown against the baseline, 0.10 is 10%");
+
+DECLARE_string(motion_model_dir);
+
+namespace {
+
+volatile double sink = 0;
+
+std::vector<int> split_ints(const std::string& list)
+{
+    std::vector<int> values;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(std::stoi(item));
+        }
+    }
+    return values;
+}
+
+/**
+ * Runs each benchmark and prints one line per result:
+ *
+ *   {"name":..., "params":{...}, "ns_per_op":median, "ns_min":..., "ns_max":..., "iterations":...}
+ */
+class Suite {
+public:
+    explicit Suite(const std::string& baseline_path)
+    {
+        if (baseline_path.empty()) {
+            return;
+        }
+        std::ifstream in(baseline_path);
+        LOG_IF(FATAL, !in) << "open " << baseline_path << " failed";
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            auto j = nlohmann::json::parse(line);
+            baseline_[key(j["name"], j["params"])] = j["ns_per_op"];
+        }
+    }
+
+    bool wanted(const std::string& name) const
+    {
+        return FLAGS_filter.empty() || name.find(FLAGS_filter) != std::string::npos;
+    }
+
+    // op() is one operation; it is called in growing batches until a batch takes min_time.
+    // between(), if given, runs after every batch, outside the timed region.
+    template <typename F>
+    void run(const std::string& name, const nlohmann::json& params, F&& op, const std::function<void()>& between = nullptr)
+    {
+        if (!wanted(name)) {
+            return;
+        }
+
+        uint64_t batch = 1;
+        std::vector<double> samples;
+        while (samples.size() < static_cast<size_t>(std::max(FLAGS_repetitions, 1))) {
+            const auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < batch; ++i) {
+                op();
+            }
+            const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (between) {
+                between();
+            }
+            if (secs < FLAGS_min_time) {
+                batch = secs <= 0 ? batch * 10 : std::max(batch * 2, static_cast<uint64_t>(batch * FLAGS_min_time * 1.2 / secs));
+                continue;
+            }
+            samples.push_back(secs * 1e9 / batch);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        nlohmann::json result;
+        result["name"] = name;
+        result["params"] = params;
+        result["ns_per_op"] = samples[samples.size() / 2];
+        result["ns_min"] = samples.front();
+        result["ns_max"] = samples.back();
+        result["iterations"] = batch;
+
+        auto base = baseline_.find(key(name, params));
+        if (base != baseline_.end()) {
+            const double change = samples[samples.size() / 2] / base->second - 1;
+            result["baseline_ns"] = base->second;
+            result["change"] = change;
+            if (change > FLAGS_tolerance) {
+                result["regression"] = true;
+                ++regressions_;
+            }
+        }
+        printf("%s\n", result.dump().c_str());
+        fflush(stdout);
+    }
+
+    int regressions() const
+    {
+        return regressions_;
+    }
+
+private:
+    static std::string key(const nlohmann::json& name, const nlohmann::json& params)
+    {
+        return name.get<std::string>() + params.dump();
+    }
+
+    std::map<std::string, double> baseline_;
+    int regressions_ = 0;
+};
+
+BallCameraConfig camera_config(size_t index, double x, double y)
+{
+    return BallCameraConfig(BallCameraBuilder::camera()
+                                ->setName("bench" + std::to_string(index))
+                                ->setDeviceSerial("BENCH" + std::to_string(index))
+                                ->setBrand("Trace")
+                                ->setAddr("BENCH" + std::to_string(index))
+                                ->setX(x)
+                                ->setY(y)
+                                ->setZ(12)
+                                ->setDp(0.5)
+                                ->setDt(-0.3)
+                                ->setZoom(20)
+                                ->setBackDp(0.5)
+                                ->setBackDt(-0.3)
+                                ->setBackZoom(20)
+                                ->setCtrlDist(300)
+                                ->setSlope(2)
+                                ->setPreset(1)
+                                ->setCtrn(1)
+                                ->build());
+}
+
+const double ORIGIN_X = 448709.0;
+const double ORIGIN_Y = 4416830.0;
+
+void bench_geometry(Suite& suite)
+{
+    auto ptz = std::make_shared<PtzController>(camera_config(0, ORIGIN_X, ORIGIN_Y), PidConfig { 0.5, 0, 0 });
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> offset(-300, 300);
+    std::vector<double> xs(1024), ys(1024);
+    for (size_t i = 0; i < xs.size(); ++i) {
+        xs[i] = ORIGIN_X + offset(rng);
+        ys[i] = ORIGIN_Y + offset(rng);
+    }
+
+    size_t i = 0;
+    suite.run("ptz.get_needed_ptz", nlohmann::json::object(), [&]() {
+        double p = 0, t = 0, z = 0;
+        ptz->get_needed_ptz(xs[i & 1023], ys[i & 1023], 0, p, t, z);
+        sink = p + t;
+        ++i;
+    });
+    suite.run("ptz.get_needed_corrected_ptz", nlohmann::json::object(), [&]() {
+        double p = 0, t = 0, z = 0;
+        const double dist = std::hypot(xs[i & 1023] - ORIGIN_X, ys[i & 1023] - ORIGIN_Y);
+        ptz->get_needed_corrected_ptz(xs[i & 1023], ys[i & 1023], 0, p, t, z, (i & 1) ? dist : -dist);
+        sink = p + t + z;
+        ++i;
+    });
+}
+
+void bench_projection(Suite& suite)
+{
+    // Points within 2 km of a camera, the area ptzctl projects.
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> offset(-0.018, 0.018);
+    std::vector<double> lats(1024), lons(1024);
+    for (size_t i = 0; i < lats.size(); ++i) {
+        lats[i] = 39.9 + offset(rng);
+        lons[i] = 116.4 + offset(rng);
+    }
+
+    size_t i = 0;
+    suite.run("projection.utmups_forward", nlohmann::json::object(), [&]() {
+        int zone = 0;
+        bool northp = true;
+        double x = 0, y = 0;
+        GeographicLib::UTMUPS::Forward(lats[i & 1023], lons[i & 1023], zone, northp, x, y, 50);
+        sink = x + y;
+        ++i;
+    });
+
+    UtmProjector tiles(50);
+    suite.run("projection.utm_projector", nlohmann::json::object(), [&]() {
+        double x = 0, y = 0;
+        tiles.forward(lats[i & 1023], lons[i & 1023], x, y);
+        sink = x + y;
+        ++i;
+    });
+
+    LocalProjector local(39.9, 116.4, 50);
+    suite.run("projection.local_projector", nlohmann::json::object(), [&]() {
+        double x = 0, y = 0;
+        local.forward(lats[i & 1023], lons[i & 1023], x, y);
+        sink = x + y;
+        ++i;
+    });
+}
+
+std::string plate_of(size_t i)
+{
+    char plate[16];
+    snprintf(plate, sizeof(plate), "京A%05zu", i % 100000);
+    return plate;
+}
+
+/**
+ * M participants spread along a road through N cameras; participant c sits 120 m
+ * from camera c and carries the plate camera c is focused on, so every camera
+ * tracks one target per frame.
+ */
+ParticipantFrame make_frame(size_t participants, size_t cameras, std::mt19937& rng)
+{
+    const double length = std::max<double>(cameras - 1, 0) * FLAGS_camera_spacing + 600;
+    std::uniform_real_distribution<double> along(-300, length - 300);
+    std::uniform_real_distribution<double> across(-15, 15);
+    std::uniform_real_distribution<double> speed(10, 30);
+    std::bernoulli_distribution has_plate(0.7);
+
+    ParticipantFrame frame;
+    const uint64_t now = VirtualClock::now().milliSecondsSinceEpoch();
+    for (size_t i = 0; i < participants; ++i) {
+        const bool focus = i < cameras;
+        const double x = focus ? i * FLAGS_camera_spacing - 120 : along(rng);
+        const std::string plate = focus ? plate_of(i) : (has_plate(rng) ? plate_of(1000 + i) : std::string());
+        frame.x.push_back(ORIGIN_X + x);
+        frame.y.push_back(ORIGIN_Y + across(rng));
+        frame.vx.push_back(speed(rng));
+        frame.vy.push_back(0);
+        frame.ptcid.push_back(10000 + i);
+        frame.plate_key.push_back(plate.empty() ? 0 : ParticipantFrame::make_plate_key(plate));
+        frame.plates.push_back(plate);
+        frame.timestamp.push_back(now);
+    }
+    frame.newest = now;
+    return frame;
+}
+
+void bench_matching(Suite& suite)
+{
+    std::mt19937 rng(9);
+    for (int participants : split_ints(FLAGS_participants)) {
+        for (int cameras : split_ints(FLAGS_cameras)) {
+            const auto frame = make_frame(participants, cameras, rng);
+            FocusIndex index;
+            for (int c = 0; c < cameras; ++c) {
+                index.set(c, 1, plate_of(c));
+            }
+            std::vector<size_t> matched;
+            suite.run("focus_index.match", { { "participants", participants }, { "cameras", cameras } }, [&]() {
+                index.match(frame, matched);
+                sink = matched[0];
+            });
+        }
+    }
+}
+
+void bench_on_receive_vehicles(Suite& suite, afl::net::EventLoop& loop)
+{
+    if (!suite.wanted("control.on_receive_vehicles")) {
+        return;
+    }
+
+    auto loop_ptr = std::shared_ptr<afl::net::EventLoop>(std::shared_ptr<void>(), &loop);
+    std::mt19937 rng(13);
+    for (int cameras : split_ints(FLAGS_cameras)) {
+        // The contexts are driven from this thread; their loop only carries camera callbacks.
+        auto zmq = std::make_shared<ZmqInteractor>();
+        CameraGrid grid(200);
+        std::vector<std::shared_ptr<ControlContext>> contexts;
+        for (int c = 0; c < cameras; ++c) {
+            const auto config = camera_config(c, ORIGIN_X + c * FLAGS_camera_spacing, ORIGIN_Y);
+            auto ptz = std::make_shared<PtzController>(config, PidConfig { 0.5, 0, 0 });
+            contexts.push_back(std::make_shared<ControlContext>(ptz, zmq, nullptr, loop_ptr));
+            contexts.back()->set_focus_method(1, plate_of(c));
+            grid.add(c, config.x, config.y, config.ctrl_dist + 50);
+        }
+
+        for (int participants : split_ints(FLAGS_participants)) {
+            const auto frame = make_frame(participants, cameras, rng);
+            std::vector<std::vector<uint32_t>> routed;
+            grid.route(frame, routed);
+            std::vector<size_t> matched(cameras, FocusIndex::npos);
+            for (int c = 0; c < cameras; ++c) {
+                // The focus target is at index c, inside camera c's area.
+                matched[c] = c;
+            }
+
+            // The commands a batch queued are drained before the next one is timed, so
+            // a repetition does not race the camera executors of the one before.
+            suite.run(
+                "control.on_receive_vehicles", { { "participants", participants }, { "cameras", cameras } }, [&]() {
+                    for (int c = 0; c < cameras; ++c) {
+                        contexts[c]->on_receive_vehicles(frame, routed[c], matched[c]);
+                    }
+                },
+                [&]() {
+                    for (auto& ctx : contexts) {
+                        ctx->wait_idle();
+                    }
+                });
+        }
+    }
+}
+
+void bench_status_json(Suite& suite)
+{
+    BallCameraStatus status;
+    status.device_serial = "210235C3UQF201000089";
+    status.focus_type = 1;
+    status.focus = "京A12345";
+    status.tracking = 1;
+    status.p = 271.146;
+    status.t = 0.916;
+    status.z = 12.5;
+    status.cmd_sent = 123456;
+    status.cmd_coalesced = 2345;
+    status.health = "closed";
+    status.queue_depth = 1;
+    status.queue_conflated = 17;
+    status.queue_stale = 3;
+    status.queue_age_ms = 0.42;
+
+    suite.run("mqtt.status_json", nlohmann::json::object(), [&]() {
+        sink = MqttInteractor::status_json(status).size();
+    });
+}
+
+void bench_lapi_parse(Suite& suite)
+{
+    const std::string move = R"({"Response":{"ResponseURL":"/LAPI/V1.0/Channels/0/PTZ/AbsoluteMove","CreatedID":-1,)"
+                             R"("ResponseCode":0,"SubResponseCode":0,"ResponseString":"Succeed","StatusCode":0,)"
+                             R"("StatusString":"Succeed","Data":{"Longitude":271.15,"Latitude":0.92}}})";
+    const std::string zoom = R"({"Response":{"ResponseURL":"/LAPI/V1.0/Channels/0/PTZ/AbsoluteZoom","CreatedID":-1,)"
+                             R"("ResponseCode":0,"SubResponseCode":0,"ResponseString":"Succeed","StatusCode":0,)"
+                             R"("StatusString":"Succeed","Data":{"ZoomRatio":12.5}}})";
+
+    suite.run("lapi.parse_ptz", nlohmann::json::object(), [&]() {
+        double p = 0, t = 0, z = 0;
+        YuShiBallCamera::parse_ptz(move, zoom, p, t, z);
+        sink = p + t + z;
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    // Timers of the contexts must not fire behind the benchmark's back, Trace cameras
+    // need no settle polling, waiting or observing and learned motion models must not land in the production directory.
+    // Nothing reads the trace here, so the cameras do not keep it.
+    VirtualClock::enable(afl::Timestamp::now());
+    TraceBallCamera::set_recording(false);
+    gflags::SetCommandLineOption("settle_poll_min_ms", "0");
+    gflags::SetCommandLineOption("settle_poll_max_ms", "0");
+    gflags::SetCommandLineOption("settle_timeout", "0.05");
+    gflags::SetCommandLineOption("motion_observe_tracking", "false");
+    if (FLAGS_motion_model_dir.empty()) {
+        char dir[] = "/tmp/control_bench_XXXXXX";
+        LOG_IF(FATAL, mkdtemp(dir) == nullptr) << "mkdtemp failed";
+        gflags::SetCommandLineOption("motion_model_dir", dir);
+    }
+
+    afl::net::EventLoopThread thread;
+    auto& loop = thread.startLoop();
+
+    Suite suite(FLAGS_baseline);
+    bench_geometry(suite);
+    bench_projection(suite);
+    bench_matching(suite);
+    bench_on_receive_vehicles(suite, loop);
+    bench_status_json(suite);
+    bench_lapi_parse(suite);
+
+    if (suite.regressions() > 0) {
+        fprintf(stderr, "%d benchmarks slower than the baseline by more than %.0f%%\n", suite.regressions(), FLAGS_tolerance * 100);
+        return 1;
+    }
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include "httplib.h"
 #include "ptz_controller.h"
 #include "read_config.h"
+#include "virtual_clock.h"
 
 #include "base/Timestamp.h"
 #include "jsonhelper/jsonpbhelper.h"
@@ -11,7 +12,28 @@
 
 #include "utils/base64.h"
 #include <GeographicLib/UTMUPS.hpp>
+#include <algorithm>
 #include <fstream>
+#include <gflags/gflags.h>
+#include <net/EventLoopThread.h>
+
+DEFINE_string(tracking_mode, "absolute", "values : absolute or velocity");
+DEFINE_int32(latency_log_interval, 60, "seconds between the per camera stage latency log lines, 0 to disable");
+DEFINE_int32(motion_save_interval, 60, "seconds between writes of the learned motion models, 0 to disable");
+DEFINE_double(route_margin, 50.0, "participants beyond ctrl_dist by up to this many meters are still routed to the camera");
+DEFINE_int32(event_upload_timeout_ms, 5000, "connect and read/write timeout of the event snapshot upload to the cloud");
+
+namespace {
+
+// 事件图片上传走单独的线程, 云端不通时不占用球机的执行队列
+afl::net::EventLoop& upload_loop()
+{
+    static afl::net::EventLoopThread thread;
+    static afl::net::EventLoop& loop = thread.startLoop();
+    return loop;
+}
+
+} // namespace
 
 ControlContext::ControlContext(std::shared_ptr<PtzController> ptz, std::shared_ptr<ZmqInteractor> zmq,
     std::shared_ptr<MqttInteractor> mqtt, std::shared_ptr<afl::net::EventLoop> loop)
@@ -19,38 +41,118 @@ ControlContext::ControlContext(std::shared_ptr<PtzController> ptz, std::shared_p
     , zmq_(zmq)
     , mqtt_(mqtt)
     , loop_(loop)
+    , handoff_(loop, [this](const ParticipantFrame& frame, const std::vector<uint32_t>& indices, size_t matched) { on_receive_vehicles(frame, indices, matched); })
 {
-    zmq->set_vehicles_callback([&](const v2x::ParticipantInfos& ptcs) { on_receive_vehicles(ptcs); });
-    zmq->set_evnets_callback([&](const v2x::EventInfos& evs) { on_receive_events(evs); });
+    const auto& config = ptz_->get_config();
+
+    // 以球机位置为原点的局部投影, 加载时与 GeographicLib 对比误差
+    double lat = 0, lon = 0;
+    GeographicLib::UTMUPS::Reverse(utm_zone(), true, config.x, config.y, lat, lon);
+    projector_ = LocalProjector(lat, lon, utm_zone());
+    const double error = projector_.max_error(std::max(config.ctrl_dist, 100.0));
+    LOG(INFO) << config.name << " projector at " << lat << "," << lon << " max error within ctrl_dist: " << error << "m";
+    LOG_IF(WARNING, error > 0.01) << config.name << " projector error " << error << "m exceeds 1cm";
+    LOG_IF(WARNING, GeographicLib::UTMUPS::StandardZone(lat, lon) != utm_zone())
+        << config.name << " lies outside UTM zone " << utm_zone() << ", check --utm_zone";
+
+    camera_geometry_ = geometry::Camera { config.x, config.y, config.z, std::tan(config.slope / 180 * M_PI) };
+
+    // 路由半径留出余量: 目标驶出控制距离后仍能被看到一次, 从而触发 reset_tracking.
+    const double radius = std::max(config.ctrl_dist + FLAGS_route_margin, 100.0);
+    // ZMQ 回调只做转交, 所有状态都在 loop_ 线程上读写.
+    subscriber_ = zmq->set_vehicles_callback(
+        [this](const std::shared_ptr<const ParticipantBatch>& batch, const std::vector<uint32_t>& indices, size_t matched) {
+            handoff_.post(batch, indices, matched);
+        },
+        config.x, config.y, radius);
+    zmq->set_evnets_callback([this](const v2x::EventInfos& evs) {
+        loop_->queueInLoop([this, evs]() { on_receive_events(evs); });
+    });
+
+    // 长时间没有控制就回到预置位, 不依赖 MQTT, 回放时也生效
+    auto reset_func = [this]() {
+        auto now = VirtualClock::now();
+        if ((afl::timeDifference(now, last_ctrl_time_) > 20) && !is_on_preset_) {
+            reset_tracking();
+            focus_ = "null";
+            focus_type_ = 0;
+            zmq_->set_focus(subscriber_, focus_type_, focus_);
+            ctrl_cnt_ = 0;
+        }
+    };
+
+    VirtualClock::run_every(*loop_, 2, reset_func);
+
+    // 速度模式下连续转动不会自己停, 匹配帧中断(目标丢失、帧被丢弃、接收卡住)时由看门狗停下
+    if (FLAGS_tracking_mode == "velocity") {
+        VirtualClock::run_every(*loop_, 0.5, [this]() { ptz_->stop_if_stalled(); });
+    }
+
+    if (FLAGS_latency_log_interval > 0) {
+        loop_->runEvery(FLAGS_latency_log_interval, [this]() {
+            LOG(INFO) << ptz_->get_config().name << " latency " << ptz_->latency().format();
+        });
+    }
+
+    // 运动模型在球机线程上学习, 定时落盘, 不在每次转动后写文件
+    if (FLAGS_motion_save_interval > 0) {
+        loop_->runEvery(FLAGS_motion_save_interval, [this]() { ptz_->save_motion_model(); });
+    }
 
     if (nullptr == mqtt) {
         return;
     }
 
-    mqtt->set_cmd_callback(std::bind(&ControlContext::on_receive_cmd, this, std::placeholders::_1));
+    mqtt->set_cmd_callback([this](const ControlCommand& cmd) {
+        loop_->queueInLoop([this, cmd]() { on_receive_cmd(cmd); });
+    });
 
     auto status_func = [&]() {
+        // 球机慢或离线时上一次查询还在执行队列里, 不再追加
+        if (status_polling_.exchange(true)) {
+            VLOG(2) << ptz_->get_config().name << " status poll still outstanding, skip";
+            return;
+        }
+
         BallCameraStatus status;
         status.device_serial = ptz_->get_config().device_serial;
         status.focus_type = focus_type_;
         status.focus = focus_;
         status.tracking = tracking_ ? 1 : 0;
-        ptz_->get_current_ptz(status.p, status.t, status.z);
-        mqtt_->send_status(status);
-    };
-
-    auto reset_func = [&]() {
-        auto now = afl::Timestamp::now();
-        if ((afl::timeDifference(now, last_ctrl_time_) > 20) && !is_on_preset_) {
-            reset_tracking();
-            focus_ = "null";
-            focus_type_ = 0;
-            ctrl_cnt_ = 0;
+        status.cmd_sent = ptz_->commands_sent();
+        status.cmd_coalesced = ptz_->commands_coalesced();
+        status.health = ptz_->health();
+        status.queue_depth = handoff_.depth();
+        status.queue_conflated = handoff_.conflated();
+        status.queue_stale = handoff_.stale();
+        status.queue_age_ms = handoff_.take_max_age_ms();
+        const auto ingest = zmq_->ingest_stats();
+        status.ingest_processed = ingest.processed;
+        status.ingest_stale = ingest.stale;
+        status.ingest_superseded = ingest.superseded;
+        status.ingest_future = ingest.future;
+        status.ingest_age_p50_ms = ingest.age_p50_ms;
+        status.ingest_age_p99_ms = ingest.age_p99_ms;
+        status.ingest_age_max_ms = ingest.age_max_ms;
+        for (int s = 0; s < StageLatency::STAGES; ++s) {
+            status.latency[s] = ptz_->latency().summary(static_cast<StageLatency::Stage>(s));
+        }
+        status.shard = shard_;
+        if (shard_stats_) {
+            const auto load = shard_stats_();
+            status.shard_cameras = load.cameras;
+            status.shard_lag_ms = load.lag_ms;
         }
+        ptz_->get_current_ptz([this, status](bool, double p, double t, double z) mutable {
+            status.p = p;
+            status.t = t;
+            status.z = z;
+            status_polling_ = false;
+            mqtt_->send_status(status);
+        });
     };
 
     loop_->runEvery(1, status_func);
-    loop_->runEvery(2, reset_func);
 }
 
 void ControlContext::set_focus_method(int type, std::string focus)
@@ -58,6 +160,7 @@ void ControlContext::set_focus_method(int type, std::string focus)
     tracking_ = false;
     focus_type_ = type;
     focus_ = std::move(focus);
+    zmq_->set_focus(subscriber_, focus_type_, focus_);
 
     // ptz_->reset_camera(ptz_->get_config().preset);
     ptz_->reset_camera_immediately(ptz_->get_config().preset);
@@ -65,6 +168,14 @@ void ControlContext::set_focus_method(int type, std::string focus)
     is_on_preset_ = true;
 }
 
+void ControlContext::set_shard_stats(size_t shard, std::function<LoopShards::Stats()> stats)
+{
+    loop_->runInLoop([this, shard, stats]() {
+        shard_ = static_cast<int>(shard);
+        shard_stats_ = stats;
+    });
+}
+
 void ControlContext::calibrate(double x, double y, double& dp, double& dt)
 {
     ptz_->calibrate(x, y, dp, dt);
@@ -73,7 +184,7 @@ void ControlContext::calibrate(double x, double y, double& dp, double& dt)
 void ControlContext::on_receive_cmd(const ControlCommand& cmd)
 {
 
-    auto now = afl::Timestamp::now().milliSecondsSinceEpoch();
+    auto now = VirtualClock::now().milliSecondsSinceEpoch();
     if (now - cmd.timestamp > 10 * 1000) {
         LOG(WARNING) << "Cmd from V2X-cloud expire!";
         return;
@@ -83,7 +194,7 @@ void ControlContext::on_receive_cmd(const ControlCommand& cmd)
     set_focus_method(cmd.focus_type, cmd.focus);
 }
 
-void ControlContext::on_receive_vehicles(const v2x::ParticipantInfos& participantInfos)
+void ControlContext::on_receive_vehicles(const ParticipantFrame& frame, const std::vector<uint32_t>& indices, size_t matched)
 {
     VLOG(1) << "Travers targets," << ptz_->get_config().name << " before focus";
 
@@ -93,41 +204,55 @@ void ControlContext::on_receive_vehicles(const v2x::ParticipantInfos& participan
 
     VLOG(1) << "Travers targets," << ptz_->get_config().name << " after focus";
 
-    for (int i = 0; i < participantInfos.participants().size(); ++i) {
-        const auto& ptc = participantInfos.participants(i);
+    // 批量计算路由到本球机的目标的距离和接近方向, 所需 P/T 由 PtzController 按偏置和提前量另算
+    batch_.resize(indices.size());
+    for (size_t k = 0; k < indices.size(); ++k) {
+        batch_.x[k] = frame.x[indices[k]];
+        batch_.y[k] = frame.y[indices[k]];
+        batch_.vx[k] = frame.vx[indices[k]];
+        batch_.vy[k] = frame.vy[indices[k]];
+    }
+    batch_.compute_distance(camera_geometry_);
 
-        int zone = 50;
-        bool north = true;
-        double x = 0, y = 0;
-        GeographicLib::UTMUPS::Forward(ptc.latitude(), ptc.longitude(), zone, north, x, y);
-        const double dist = std::hypot(ptz_->get_config().x - x, ptz_->get_config().y - y);
+    for (size_t k = 0; k < indices.size(); ++k) {
+        const size_t i = indices[k];
+        const double x = batch_.x[k];
+        const double y = batch_.y[k];
+        const double speedx = batch_.vx[k];
+        const double speedy = batch_.vy[k];
+        const double dist = batch_.dist[k];
 
         // 7.2_新增代码 1: 如果目标距离近，则更新方向
         if (std::hypot(direction_.first, direction_.second) < 1e-4 && dist < 100.0) {
-            direction_.first = ptc.speedx();
-            direction_.second = ptc.speedy();
+            direction_.first = speedx;
+            direction_.second = speedy;
         }
 
-        if (!ptc.plate().empty()) {
-            VLOG(1) << "Travers targets," << ptz_->get_config().name << " track_id:" << ptc.ptcid()
-                    << " timestamp:" << ptc.timestamp() / 1000
-                    << " plate:" << ptc.plate() << " dist:" << dist;
+        if (0 != frame.plate_key[i]) {
+            VLOG(1) << "Travers targets," << ptz_->get_config().name << " track_id:" << frame.ptcid[i]
+                    << " timestamp:" << frame.timestamp[i] / 1000
+                    << " plate:" << frame.plate(i) << " dist:" << dist;
         }
 
-        if (!is_matched(ptc)) {
+        if (i != matched) {
             continue;
         }
 
+        // 分段延时: 感知时间戳 -> 收到消息 -> 匹配到目标, 后两段在 PtzController 里记录
+        const int64_t matched_us = VirtualClock::now().microSecondsSinceEpoch();
+        ptz_->latency().record(StageLatency::SENSOR_TO_RECEIVE, frame.received - static_cast<int64_t>(frame.timestamp[i]) * 1000);
+        ptz_->latency().record(StageLatency::RECEIVE_TO_MATCH, matched_us - frame.received);
+
         if (0 != (ctrl_cnt_++ % ptz_->get_config().ctrn)) {
             VLOG(2) << ptz_->get_config().name << " skip control! ctrl cnt:" << ctrl_cnt_ << " ctrn:" << ptz_->get_config().ctrn;
             return;
         }
 
-        auto now = afl::Timestamp::now();
-        LOG(INFO) << "Vehicle Matched " << ptz_->get_config().name << " track_id:" << ptc.ptcid()
+        auto now = VirtualClock::now();
+        LOG(INFO) << "Vehicle Matched " << ptz_->get_config().name << " track_id:" << frame.ptcid[i]
                   << " delta_x:" << x - ptz_->get_config().x << " delta_y:" << y - ptz_->get_config().y
-                  << " tdiff:" << now.milliSecondsSinceEpoch() - ptc.timestamp()
-                  << " plate: " << ptc.plate() << " dist:" << dist;
+                  << " tdiff:" << now.milliSecondsSinceEpoch() - static_cast<int64_t>(frame.timestamp[i])
+                  << " plate: " << frame.plate(i) << " dist:" << dist;
 
         if (dist < ptz_->get_config().ctrl_dist) {
             if (!tracking_) {
@@ -137,7 +262,7 @@ void ControlContext::on_receive_vehicles(const v2x::ParticipantInfos& participan
 
             tracking_ = true;
 
-            const auto sign = (x - ptz_->get_config().x) * ptc.speedx() + (y - ptz_->get_config().y) * ptc.speedy();
+            const auto sign = batch_.approach[k];
             const bool move_away = (sign > 0);
 
             LOG(INFO) << "Matched Vehicle is coming? " << bool(sign < 0) << " " << move_away << " " << dist;
@@ -151,8 +276,11 @@ void ControlContext::on_receive_vehicles(const v2x::ParticipantInfos& participan
                     ctrl_cnt_ = 0;
                 }
             } else {
-                ptz_->on_vehicle_detected_adjust_zoom(x + 1.5 * ptc.speedx(), y + 1.5 * ptc.speedy(), 0,
-                    ptc.speedx(), ptc.speedy());
+                if (FLAGS_tracking_mode == "velocity") {
+                    ptz_->on_vehicle_tracked(x, y, 0, speedx, speedy);
+                }
+                ptz_->on_vehicle_detected_adjust_zoom(x + 1.5 * speedx, y + 1.5 * speedy, 0,
+                    speedx, speedy);
             }
 
             is_on_preset_ = false;
@@ -169,9 +297,7 @@ void ControlContext::on_receive_vehicles(const v2x::ParticipantInfos& participan
 int ControlContext::event_pos(const double& lon, const double& lat)
 {
     double event_x = 0.0, event_y = 0.0;
-    int zone = 50;
-    bool north = true;
-    GeographicLib::UTMUPS::Forward(lat, lon, zone, north, event_x, event_y);
+    projector_.forward(lat, lon, event_x, event_y);
     const auto sign = (event_x - ptz_->get_config().x) * direction_.first + (event_y - ptz_->get_config().y) * direction_.second;
 
     return sign < 1e-6 ? 7 : 102;
@@ -186,6 +312,9 @@ bool get_event_url(const std::string& image, std::string& output)
     const std::string url = "/ihs/monitor/minioFile/upload";
     try {
         httplib::Client cli(addr, 80);
+        cli.set_connection_timeout(std::chrono::milliseconds(FLAGS_event_upload_timeout_ms));
+        cli.set_read_timeout(std::chrono::milliseconds(FLAGS_event_upload_timeout_ms));
+        cli.set_write_timeout(std::chrono::milliseconds(FLAGS_event_upload_timeout_ms));
 
         httplib::MultipartFormData item;
         item.name = "file";
@@ -222,6 +351,11 @@ void ControlContext::on_receive_events(const v2x::EventInfos& eventinfos)
         return;
     }
 
+    // 上一次事件抓拍还没结束
+    if (event_capturing_) {
+        return;
+    }
+
     v2x::EventInfos einfos;
     einfos.CopyFrom(eventinfos);
 
@@ -231,19 +365,17 @@ void ControlContext::on_receive_events(const v2x::EventInfos& eventinfos)
     }
 
     // 7.2_新增代码5: 判断此次收到事件的时间到上次球机拍摄的时间是否小于一分钟，如果是，直接过滤
-    if (events_valid_.valid() && afl::timeDifference(afl::Timestamp::now(), events_valid_) < (1 * 60)) {
+    if (events_valid_.valid() && afl::timeDifference(VirtualClock::now(), events_valid_) < (1 * 60)) {
         VLOG(5) << "Ignore jam event, in 1*60 s";
         return;
     }
 
-    auto now = afl::Timestamp::now();
+    auto now = VirtualClock::now();
 
     // 7.2_新增代码6: 过滤事件，只保留一个事件
     for (auto iter = einfos.ihstrafficeventlist().begin(); iter != einfos.ihstrafficeventlist().end();) {
-        int zone = 50;
-        bool north = true;
         double x = 0, y = 0;
-        GeographicLib::UTMUPS::Forward(iter->latitude(), iter->longitude(), zone, north, x, y);
+        projector_.forward(iter->latitude(), iter->longitude(), x, y);
 
         const double dist = std::hypot(ptz_->get_config().x - x, ptz_->get_config().y - y);
 
@@ -282,34 +414,52 @@ void ControlContext::on_receive_events(const v2x::EventInfos& eventinfos)
     iter = einfos.ihstrafficeventlist().begin();
 
     //             7.2_转向预置位，抓拍图片并把结果转换为base64
-    ptz_->reset_camera(event_pos(iter->longitude(), iter->latitude()));
-    std::string pic;
-    ptz_->snapshot(pic);
-    LOG(INFO) << "Get snapshot size:" << pic.size();
-
-    // std::string image_base64 = afl::base64Encode(pic);
-
-    //             7.2_向云端发送信息，输入base64，获取到url，更新事件中的images
-    std::string output = "null";
-    if (get_event_url(pic, output)) {
-        auto& str = *einfos.mutable_ihstrafficeventlist(0)->add_images();
-        str = output;
+    //             转向和抓拍都在球机自己的执行队列里排队，这里不等待
+    event_capturing_ = true;
+
+    const auto eventtype = iter->eventtype();
+    const int preset = event_pos(iter->longitude(), iter->latitude());
+    auto shared_einfos = std::make_shared<v2x::EventInfos>(std::move(einfos));
+    auto on_snapshot = [this, shared_einfos, eventtype, now](bool, std::string& pic) {
+        LOG(INFO) << "Get snapshot size:" << pic.size();
+
+        // std::string image_base64 = afl::base64Encode(pic);
+
+        //             7.2_向云端发送信息，输入base64，获取到url，更新事件中的images
+        //             抓拍回调在球机执行队列上, 上传交给上传线程, event_capturing_ 只在控制线程上复位
+        upload_loop().queueInLoop([this, shared_einfos, eventtype, now, image = std::move(pic)]() {
+            std::string output = "null";
+            const bool ok = get_event_url(image, output);
+            if (ok) {
+                auto& str = *shared_einfos->mutable_ihstrafficeventlist(0)->add_images();
+                str = output;
+
+                LOG(INFO) << "zzs_image: " << output;
+                auto json = JsonPbHelper::pb2Json(*shared_einfos);
+
+                if (!json["ihsTrafficEventList"].empty() && json["ihsTrafficEventList"].is_array()) {
+                    if (!json["ihsTrafficEventList"][0]["images"].empty() && json["ihsTrafficEventList"][0]["images"].is_array())
+                        json["ihsTrafficEventList"][0]["images"][0] = output;
+                }
 
-        LOG(INFO) << "zzs_image: " << output;
-        auto json = JsonPbHelper::pb2Json(einfos);
+                mqtt_->send_event(json.dump());
+            } else {
+                VLOG(4) << "get_event_url failed.";
+            }
 
-        if (!json["ihsTrafficEventList"].empty() && json["ihsTrafficEventList"].is_array()) {
-            if (!json["ihsTrafficEventList"][0]["images"].empty() && json["ihsTrafficEventList"][0]["images"].is_array())
-                json["ihsTrafficEventList"][0]["images"][0] = output;
-        }
+            loop_->runInLoop([this, ok, eventtype, now]() {
+                // 7.2_新增代码8 : 更新抓图时间
+                if (ok) {
+                    events_valid_ = now;
+                    events_last_time_[eventtype] = now;
+                }
+                event_capturing_ = false;
+            });
+        });
+    };
 
-        mqtt_->send_event(json.dump());
-        // 7.2_新增代码8 : 更新抓图时间
-        events_valid_ = now;
-        events_last_time_[iter->eventtype()] = now;
-    } else {
-        VLOG(4) << "get_event_url failed.";
-    }
+    //             球机到位后立即抓拍
+    ptz_->reset_camera(preset, [this, on_snapshot](bool) { ptz_->snapshot(on_snapshot); });
 }
 
 void ControlContext::get_current_ptz(double& p, double& t, double& z)
@@ -322,22 +472,19 @@ void ControlContext::set_ptz_directly(double p, double t, double z)
     ptz_->reset_camera(p, t, z);
 }
 
-bool ControlContext::is_matched(const v2x::ParticipantInfos_Participants& ptc)
+void ControlContext::wait_idle()
 {
-    if (1 == focus_type_) {
-        return (ptc.plate() == focus_);
-    }
-    if (2 == focus_type_) {
-        return (std::to_string(ptc.ptcid()) == focus_);
-    }
-
-    return false;
+    ptz_->wait_idle();
 }
 
 void ControlContext::reset_tracking()
 {
+    if (tracking_ && FLAGS_tracking_mode == "velocity") {
+        ptz_->stop_tracking();
+    }
+
     if (tracking_) {
-        loop_->runAfter(10, [&]() {
+        VirtualClock::run_after(*loop_, 10, [&]() {
             ptz_->reset_camera(ptz_->get_config().preset);
         });
     }
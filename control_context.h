@@ -1,12 +1,19 @@
 #pragma once
 
 #include "comm.h"
+#include "frame_handoff.h"
+#include "geo_projector.h"
+#include "geometry_kernel.h"
+#include "loop_shards.h"
 #include "mqtt_interactor.h"
+#include "participant_frame.h"
 #include "ptz_controller.h"
+#include "virtual_clock.h"
 
 #include <ihspb/pub-sub.pb.h>
 #include <net/EventLoop.h>
 
+#include <atomic>
 #include <cmath>
 #include <memory>
 #include <string>
@@ -22,19 +29,21 @@ public:
         std::shared_ptr<MqttInteractor> mqtt, std::shared_ptr<afl::net::EventLoop> loop);
 
     void set_focus_method(int type, std::string focus);
+    // The load of the loop shard this context runs on, published with the status.
+    void set_shard_stats(size_t shard, std::function<LoopShards::Stats()> stats);
 
-    void on_receive_vehicles(const v2x::ParticipantInfos& participantInfos); // from zmq
+    void on_receive_vehicles(const ParticipantFrame& frame, const std::vector<uint32_t>& indices, size_t matched); // from zmq
     void on_receive_events(const v2x::EventInfos& eventinfos); // from zmq
 
     void get_current_ptz(double& p, double& t, double& z);
     void set_ptz_directly(double p, double t, double z);
+    void wait_idle();
 
     void calibrate(double x, double y, double& dp, double& dt);
     int event_pos(const double& lon, const double& lat);
 
 private:
     void on_receive_cmd(const ControlCommand& cmd); // from mqtt
-    bool is_matched(const ::v2x::ParticipantInfos_Participants& ptc);
     void reset_tracking();
 
 private:
@@ -45,17 +54,27 @@ private:
     bool see_back_ = false;
     int focus_type_;
     std::string focus_;
+    uint32_t subscriber_ = 0; // our id in ZmqInteractor's focus index
 
     size_t ctrl_cnt_ = 0;
-    afl::Timestamp last_ctrl_time_ = afl::Timestamp::now();
+    afl::Timestamp last_ctrl_time_ = VirtualClock::now();
     afl::Timestamp event_report_time_ = last_ctrl_time_;
     std::unordered_map<uint32_t, afl::Timestamp> events_last_time_;
     afl::Timestamp events_valid_ = afl::Timestamp();
 
+    int shard_ = -1;
+    std::function<LoopShards::Stats()> shard_stats_;
+
     bool is_on_preset_ = true;
+    bool event_capturing_ = false; // an event snapshot is on its way, only touched on loop_
+    std::atomic<bool> status_polling_ { false }; // a get_current_ptz for the status is queued on the camera
 
     std::shared_ptr<PtzController> ptz_;
     std::shared_ptr<ZmqInteractor> zmq_;
     std::shared_ptr<MqttInteractor> mqtt_;
     std::shared_ptr<afl::net::EventLoop> loop_;
+    FrameHandoff handoff_;
+    LocalProjector projector_; // around the camera, for event positions
+    geometry::Camera camera_geometry_;
+    geometry::Batch batch_; // scratch for on_receive_vehicles
 };
\ No newline at end of file
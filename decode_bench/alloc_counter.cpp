@@ -0,0 +1,10 @@
+#include "alloc_counter.h"
+
+namespace alloc_counter {
+thread_local uint64_t allocations = 0;
+}
+
+uint64_t thread_allocations()
+{
+    return alloc_counter::allocations;
+}
@@ -0,0 +1,15 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+// Number of operator new calls made by the calling thread so far, counted by the
+// replacement operator new in alloc_hook.cpp. Bench only, ptzctl keeps the plain
+// allocator and does not count.
+uint64_t thread_allocations();
+
+namespace alloc_counter {
+extern thread_local uint64_t allocations;
+}
+
+#endif // ALLOC_COUNTER_H
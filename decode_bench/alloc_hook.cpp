@@ -0,0 +1,52 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new to count heap allocations per thread, so hot
+// paths can show that they do not touch the heap in steady state. Linked into the
+// bench targets only, so ptzctl keeps the plain allocator.
+
+void* operator new(std::size_t size)
+{
+    ++alloc_counter::allocations;
+    if (size == 0) {
+        size = 1;
+    }
+    while (true) {
+        void* p = std::malloc(size);
+        if (p) {
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,152 @@
+/**
+ * @brief Compares ParticipantDecoder with ParseFromArray + ParticipantFrame::assign.
+ *
+ * Frames come from a capture (--capture), from --frames (a file of little-endian
+ * uint32 length prefixed ParticipantInfos payloads) or are synthesized. Both paths must produce the same
+ * frame; the tool checks that before timing them.
+ */
+#include "alloc_counter.h"
+#include "../capture_file.h"
+#include "../participant_decoder.h"
+#include "../participant_frame.h"
+
+#include <common/appprotocol.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+DEFINE_string(capture, "", "Capture segment or directory written with --capture_dir");
+DEFINE_string(topic, "", "Topic of the vehicle frames in the capture, empty for algoTargetTopic");
+DEFINE_string(frames, "", "Recorded frames, uint32 length prefixed; empty to synthesize");
+DEFINE_int32(synth_frames, 200, "Synthesized frames");
+DEFINE_int32(participants, 300, "Participants per synthesized frame");
+DEFINE_int32(rounds, 20, "Passes over all frames per decoder");
+
+namespace {
+
+std::vector<std::string> load_frames(const std::string& path)
+{
+    std::vector<std::string> frames;
+    std::ifstream in(path, std::ios::binary);
+    LOG_IF(FATAL, !in) << "open " << path << " failed";
+
+    uint32_t size = 0;
+    while (in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+        std::string frame(size, '\0');
+        if (!in.read(&frame[0], size)) {
+            break;
+        }
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+std::vector<std::string> load_capture(const std::string& path)
+{
+    const std::string topic = FLAGS_topic.empty() ? std::string(algoTargetTopic) : FLAGS_topic;
+    std::vector<std::string> frames;
+    capture::Reader reader(path);
+    capture::Record record;
+    while (reader.next(record)) {
+        if (topic.compare(0, std::string::npos, record.topic, record.topic_size) == 0) {
+            frames.emplace_back(record.payload, record.payload_size);
+        }
+    }
+    return frames;
+}
+
+std::vector<std::string> synthesize_frames()
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> offset(-0.01, 0.01);
+    std::uniform_real_distribution<double> speed(-30, 30);
+
+    std::vector<std::string> frames;
+    for (int f = 0; f < FLAGS_synth_frames; ++f) {
+        v2x::ParticipantInfos infos;
+        for (int i = 0; i < FLAGS_participants; ++i) {
+            auto* ptc = infos.add_participants();
+            ptc->set_ptcid(100000 + i);
+            ptc->set_latitude(39.9 + offset(rng));
+            ptc->set_longitude(116.4 + offset(rng));
+            ptc->set_speedx(speed(rng));
+            ptc->set_speedy(speed(rng));
+            ptc->set_timestamp(1700000000000ULL + f * 100);
+            if (i % 3 == 0) {
+                ptc->set_plate("京A" + std::to_string(10000 + i));
+            }
+        }
+        frames.push_back(infos.SerializeAsString());
+    }
+    return frames;
+}
+
+bool same(const ParticipantFrame& a, const ParticipantFrame& b)
+{
+    return a.x == b.x && a.y == b.y && a.vx == b.vx && a.vy == b.vy && a.ptcid == b.ptcid
+        && a.plate_key == b.plate_key && a.plates == b.plates && a.timestamp == b.timestamp;
+}
+
+template <typename F>
+void run(const char* name, const std::vector<std::string>& frames, size_t participants, F&& decode)
+{
+    const uint64_t allocs = thread_allocations();
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < FLAGS_rounds; ++r) {
+        for (const auto& frame : frames) {
+            decode(frame);
+        }
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const double n = static_cast<double>(frames.size()) * FLAGS_rounds;
+    printf("%-12s %10.1f us/frame %10.1f ns/participant %8.2f allocs/frame\n", name,
+        secs * 1e6 / n, secs * 1e9 / (n * participants / frames.size()),
+        (thread_allocations() - allocs) / n);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    const auto frames = !FLAGS_capture.empty() ? load_capture(FLAGS_capture)
+        : !FLAGS_frames.empty()                 ? load_frames(FLAGS_frames)
+                                                : synthesize_frames();
+    LOG_IF(FATAL, frames.empty()) << "no frames";
+
+    v2x::ParticipantInfos infos;
+    ParticipantFrame full;
+    ParticipantFrame selective;
+    ParticipantDecoder decoder;
+
+    size_t participants = 0;
+    size_t bytes = 0;
+    for (const auto& frame : frames) {
+        CHECK(infos.ParseFromArray(frame.data(), frame.size()));
+        full.assign(infos);
+        CHECK(decoder.decode(frame.data(), frame.size(), selective));
+        CHECK(same(full, selective)) << "decoders disagree";
+        participants += full.size();
+        bytes += frame.size();
+    }
+    printf("%zu frames, %.1f participants/frame, %.1f bytes/frame\n", frames.size(),
+        static_cast<double>(participants) / frames.size(), static_cast<double>(bytes) / frames.size());
+
+    run("ParseFromArray", frames, participants, [&](const std::string& frame) {
+        infos.ParseFromArray(frame.data(), frame.size());
+        full.assign(infos);
+    });
+    run("selective", frames, participants, [&](const std::string& frame) {
+        decoder.decode(frame.data(), frame.size(), selective);
+    });
+
+    return 0;
+}
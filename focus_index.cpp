@@ -0,0 +1,88 @@
+#include "focus_index.h"
+
+#include <algorithm>
+#include <cctype>
+
+constexpr size_t FocusIndex::npos;
+
+namespace {
+
+// ptcid focus arrives as text; it only ever matched its canonical decimal form.
+bool parse_ptcid(const std::string& focus, uint64_t& ptcid)
+{
+    if (focus.empty() || focus.size() > 20 || !std::all_of(focus.begin(), focus.end(), ::isdigit)) {
+        return false;
+    }
+
+    ptcid = std::stoull(focus);
+    return std::to_string(ptcid) == focus;
+}
+
+} // namespace
+
+void FocusIndex::set(uint32_t subscriber, int type, const std::string& focus)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (focus_.size() <= subscriber) {
+        focus_.resize(subscriber + 1);
+    }
+
+    erase(subscriber, focus_[subscriber]);
+
+    Focus next;
+    if (1 == type) {
+        next.type = type;
+        next.plate = focus;
+        next.key = ParticipantFrame::make_plate_key(focus);
+        by_plate_[next.key].push_back(subscriber);
+    } else if (2 == type && parse_ptcid(focus, next.key)) {
+        next.type = type;
+        by_ptcid_[next.key].push_back(subscriber);
+    }
+
+    focus_[subscriber] = std::move(next);
+}
+
+void FocusIndex::erase(uint32_t subscriber, const Focus& focus)
+{
+    auto& index = (1 == focus.type) ? by_plate_ : by_ptcid_;
+    auto iter = index.find(focus.key);
+    if (0 == focus.type || iter == index.end()) {
+        return;
+    }
+
+    auto& subscribers = iter->second;
+    subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), subscriber), subscribers.end());
+    if (subscribers.empty()) {
+        index.erase(iter);
+    }
+}
+
+void FocusIndex::match(const ParticipantFrame& frame, std::vector<size_t>& matched) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    matched.assign(focus_.size(), npos);
+    if (by_plate_.empty() && by_ptcid_.empty()) {
+        return;
+    }
+
+    for (size_t i = 0; i < frame.size(); ++i) {
+        auto plate = by_plate_.find(frame.plate_key[i]);
+        if (plate != by_plate_.end()) {
+            for (auto subscriber : plate->second) {
+                if (npos == matched[subscriber] && frame.plate(i) == focus_[subscriber].plate) {
+                    matched[subscriber] = i;
+                }
+            }
+        }
+
+        auto ptcid = by_ptcid_.find(frame.ptcid[i]);
+        if (ptcid != by_ptcid_.end()) {
+            for (auto subscriber : ptcid->second) {
+                if (npos == matched[subscriber]) {
+                    matched[subscriber] = i;
+                }
+            }
+        }
+    }
+}
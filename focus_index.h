@@ -0,0 +1,45 @@
+#ifndef FOCUS_INDEX_H
+#define FOCUS_INDEX_H
+
+#include "participant_frame.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Maps each focus target, by plate or by ptcid, to the subscribers focused on it.
+ *
+ * Written when a camera's focus changes and read once per participant per frame, so
+ * matching a frame costs one hash lookup per participant however many cameras there
+ * are.
+ */
+class FocusIndex {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // type: 0 none, 1 plate, 2 ptcid. Replaces whatever the subscriber was focused on.
+    void set(uint32_t subscriber, int type, const std::string& focus);
+
+    // matched[subscriber] receives the first participant matching its focus, or npos.
+    void match(const ParticipantFrame& frame, std::vector<size_t>& matched) const;
+
+private:
+    struct Focus {
+        int type = 0;
+        std::string plate;
+        uint64_t key = 0; // plate key for type 1, ptcid for type 2
+    };
+
+    void erase(uint32_t subscriber, const Focus& focus);
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<Focus> focus_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> by_plate_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> by_ptcid_;
+};
+
+#endif // FOCUS_INDEX_H
@@ -0,0 +1,97 @@
+#include "frame_handoff.h"
+#include "virtual_clock.h"
+
+#include <gflags/gflags.h>
+
+DECLARE_int32(max_frame_age_ms);
+
+FrameHandoff::FrameHandoff(std::shared_ptr<afl::net::EventLoop> loop, Handler handler)
+    : loop_(std::move(loop))
+    , handler_(std::move(handler))
+{
+}
+
+FrameHandoff::~FrameHandoff()
+{
+    delete pending_.exchange(nullptr);
+    delete spare_.exchange(nullptr);
+}
+
+void FrameHandoff::post(const std::shared_ptr<const ParticipantBatch>& batch, const std::vector<uint32_t>& indices, size_t matched)
+{
+    Delivery* delivery = spare_.exchange(nullptr);
+    if (nullptr == delivery) {
+        delivery = new Delivery();
+    }
+
+    delivery->batch = batch;
+    delivery->indices.assign(indices.begin(), indices.end());
+    delivery->matched = matched;
+    delivery->posted = afl::Timestamp::now();
+
+    Delivery* replaced = pending_.exchange(delivery);
+    if (nullptr != replaced) {
+        // The loop has not picked the older frame up yet and will take this one instead.
+        ++conflated_;
+        recycle(replaced);
+        return;
+    }
+
+    loop_->queueInLoop([this]() { drain(); });
+}
+
+void FrameHandoff::drain()
+{
+    Delivery* delivery = pending_.exchange(nullptr);
+    if (nullptr == delivery) {
+        return;
+    }
+
+    const auto now = afl::Timestamp::now();
+    const int64_t age = now.microSecondsSinceEpoch() - delivery->posted.microSecondsSinceEpoch();
+    int64_t max_age = max_age_us_;
+    while (age > max_age && !max_age_us_.compare_exchange_weak(max_age, age)) {
+    }
+
+    const auto& frame = delivery->batch->frame;
+    const int64_t frame_age_ms = VirtualClock::now().milliSecondsSinceEpoch() - static_cast<int64_t>(frame.newest);
+    if (FLAGS_max_frame_age_ms > 0 && frame.size() != 0 && frame_age_ms > FLAGS_max_frame_age_ms) {
+        ++stale_;
+    } else {
+        handler_(frame, delivery->indices, delivery->matched);
+        ++delivered_;
+    }
+    recycle(delivery);
+}
+
+void FrameHandoff::recycle(Delivery* delivery)
+{
+    // Release the batch now so ZmqInteractor can reuse it.
+    delivery->batch.reset();
+    delete spare_.exchange(delivery);
+}
+
+size_t FrameHandoff::depth() const
+{
+    return nullptr == pending_.load() ? 0 : 1;
+}
+
+uint64_t FrameHandoff::delivered() const
+{
+    return delivered_;
+}
+
+uint64_t FrameHandoff::conflated() const
+{
+    return conflated_;
+}
+
+uint64_t FrameHandoff::stale() const
+{
+    return stale_;
+}
+
+double FrameHandoff::take_max_age_ms()
+{
+    return max_age_us_.exchange(0) / 1000.0;
+}
@@ -0,0 +1,65 @@
+#ifndef FRAME_HANDOFF_H
+#define FRAME_HANDOFF_H
+
+#include "participant_frame.h"
+
+#include <base/Timestamp.h>
+#include <net/EventLoop.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Hands vehicle frames from the ZMQ reader thread to a context's event loop.
+ *
+ * A single lock-free slot holds the newest undelivered frame: posting over a pending
+ * frame replaces it (conflation), so a slow loop only ever sees the latest state and
+ * never holds up the reader. The loop is woken only when the slot goes from empty to
+ * full, and the delivery buffers are recycled so steady state does not allocate.
+ * A frame that has grown older than --max_frame_age_ms by the time the loop gets
+ * to it is dropped instead of handled.
+ */
+class FrameHandoff {
+public:
+    using Handler = std::function<void(const ParticipantFrame& frame, const std::vector<uint32_t>& indices, size_t matched)>;
+
+    FrameHandoff(std::shared_ptr<afl::net::EventLoop> loop, Handler handler);
+    ~FrameHandoff();
+
+    // Any thread.
+    void post(const std::shared_ptr<const ParticipantBatch>& batch, const std::vector<uint32_t>& indices, size_t matched);
+
+    size_t depth() const; // 0 or 1
+    uint64_t delivered() const;
+    uint64_t conflated() const;
+    uint64_t stale() const;
+    // Largest post-to-handle delay since the last call, in milliseconds.
+    double take_max_age_ms();
+
+private:
+    struct Delivery {
+        std::shared_ptr<const ParticipantBatch> batch;
+        std::vector<uint32_t> indices;
+        size_t matched;
+        afl::Timestamp posted;
+    };
+
+    void drain();
+    void recycle(Delivery* delivery);
+
+private:
+    std::shared_ptr<afl::net::EventLoop> loop_;
+    Handler handler_;
+
+    std::atomic<Delivery*> pending_ { nullptr };
+    std::atomic<Delivery*> spare_ { nullptr };
+
+    std::atomic<uint64_t> delivered_ { 0 };
+    std::atomic<uint64_t> conflated_ { 0 };
+    std::atomic<uint64_t> stale_ { 0 };
+    std::atomic<int64_t> max_age_us_ { 0 };
+};
+
+#endif // FRAME_HANDOFF_H
@@ -0,0 +1,52 @@
+/**
+ * @brief Checks LocalProjector against UTMUPS::Forward before it is trusted.
+ *
+ * For a grid of origins across the UTM zones and latitudes ptzctl can be deployed
+ * at, measures LocalProjector::max_error within --ctrl_dist and exits non-zero if
+ * any origin exceeds --max_error_cm. Origins span the whole zone, since cameras
+ * near a zone edge are projected into the configured zone, not their own.
+ */
+#include "../geo_projector.h"
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <cstdio>
+
+DEFINE_int32(zone_min, 43, "First UTM zone checked");
+DEFINE_int32(zone_max, 53, "Last UTM zone checked");
+DEFINE_double(lat_min, 18, "Southernmost origin latitude, degrees");
+DEFINE_double(lat_max, 54, "Northernmost origin latitude, degrees");
+DEFINE_double(lat_step, 1, "Latitude spacing of the origins, degrees");
+DEFINE_double(lon_step, 0.5, "Longitude spacing of the origins within a zone, degrees");
+DEFINE_double(ctrl_dist, 550, "Radius the projection must hold over, metres (ctrl_dist plus route_margin)");
+DEFINE_double(max_error_cm, 1.0, "Largest error accepted within ctrl_dist, centimetres");
+
+int main(int argc, char** argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    int origins = 0;
+    int failed = 0;
+    double worst = 0;
+    for (int zone = FLAGS_zone_min; zone <= FLAGS_zone_max; ++zone) {
+        const double meridian = zone * 6 - 183;
+        double zone_worst = 0;
+        for (double lat = FLAGS_lat_min; lat <= FLAGS_lat_max + 1e-9; lat += FLAGS_lat_step) {
+            for (double lon = meridian - 3; lon <= meridian + 3 + 1e-9; lon += FLAGS_lon_step) {
+                const double error = LocalProjector(lat, lon, zone).max_error(FLAGS_ctrl_dist) * 100;
+                ++origins;
+                zone_worst = std::max(zone_worst, error);
+                if (error > FLAGS_max_error_cm) {
+                    ++failed;
+                    printf("FAIL zone:%d origin:%.3f,%.3f error:%.4fcm\n", zone, lat, lon, error);
+                }
+            }
+        }
+        printf("zone:%d worst error within %.0fm: %.4fcm\n", zone, FLAGS_ctrl_dist, zone_worst);
+        worst = std::max(worst, zone_worst);
+    }
+
+    printf("origins:%d failed:%d worst error: %.4fcm limit: %.4fcm\n", origins, failed, worst, FLAGS_max_error_cm);
+    return failed == 0 ? 0 : 1;
+}
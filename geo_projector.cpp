@@ -0,0 +1,120 @@
+#include "geo_projector.h"
+
+#include <GeographicLib/UTMUPS.hpp>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <cmath>
+
+DEFINE_int32(utm_zone, 50, "UTM zone of the camera coordinates in the config; positions are always projected into it");
+
+namespace {
+
+const double TILE_DEGREES = 0.02;
+const double STEP_DEGREES = 1e-3;
+const double METERS_PER_DEGREE = 111320.0;
+
+void utm_forward(double lat, double lon, int zone, double& x, double& y)
+{
+    int z = 0;
+    bool north = true;
+    GeographicLib::UTMUPS::Forward(lat, lon, z, north, x, y, zone);
+}
+
+} // namespace
+
+int utm_zone()
+{
+    return FLAGS_utm_zone;
+}
+
+LocalProjector::LocalProjector(double lat0, double lon0, int zone)
+    : lat0_(lat0)
+    , lon0_(lon0)
+    , zone_(zone)
+{
+    // Samples f(i*h, j*h) for i, j in {-1, 0, 1}, with u = dlon and v = dlat.
+    const double h = STEP_DEGREES;
+    double fx[3][3], fy[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            utm_forward(lat0 + (j - 1) * h, lon0 + (i - 1) * h, zone, fx[i][j], fy[i][j]);
+        }
+    }
+
+    auto fit = [h](double f[3][3], double c[6]) {
+        c[0] = f[1][1];
+        c[1] = (f[2][1] - f[0][1]) / (2 * h);
+        c[2] = (f[1][2] - f[1][0]) / (2 * h);
+        c[3] = (f[2][1] - 2 * f[1][1] + f[0][1]) / (2 * h * h);
+        c[4] = (f[2][2] - f[2][0] - f[0][2] + f[0][0]) / (4 * h * h);
+        c[5] = (f[1][2] - 2 * f[1][1] + f[1][0]) / (2 * h * h);
+    };
+    fit(fx, x_);
+    fit(fy, y_);
+}
+
+void LocalProjector::forward(double lat, double lon, double& x, double& y) const
+{
+    const double u = lon - lon0_;
+    const double v = lat - lat0_;
+    const double uu = u * u;
+    const double uv = u * v;
+    const double vv = v * v;
+    x = x_[0] + x_[1] * u + x_[2] * v + x_[3] * uu + x_[4] * uv + x_[5] * vv;
+    y = y_[0] + y_[1] * u + y_[2] * v + y_[3] * uu + y_[4] * uv + y_[5] * vv;
+}
+
+double LocalProjector::max_error(double radius) const
+{
+    const double dlat = radius / METERS_PER_DEGREE;
+    const double dlon = dlat / std::cos(lat0_ * M_PI / 180.0);
+
+    double worst = 0;
+    for (int ring = 1; ring <= 4; ++ring) {
+        for (int k = 0; k < 32; ++k) {
+            const double a = 2 * M_PI * k / 32;
+            const double lat = lat0_ + ring / 4.0 * dlat * std::sin(a);
+            const double lon = lon0_ + ring / 4.0 * dlon * std::cos(a);
+
+            double x = 0, y = 0, ex = 0, ey = 0;
+            forward(lat, lon, x, y);
+            utm_forward(lat, lon, zone_, ex, ey);
+            worst = std::max(worst, std::hypot(x - ex, y - ey));
+        }
+    }
+    return worst;
+}
+
+double LocalProjector::latitude() const
+{
+    return lat0_;
+}
+
+double LocalProjector::longitude() const
+{
+    return lon0_;
+}
+
+UtmProjector::UtmProjector(int zone)
+    : zone_(zone)
+{
+}
+
+void UtmProjector::forward(double lat, double lon, double& x, double& y)
+{
+    const int64_t row = static_cast<int64_t>(std::floor(lat / TILE_DEGREES));
+    const int64_t col = static_cast<int64_t>(std::floor(lon / TILE_DEGREES));
+    const int64_t key = (row + (1 << 16)) << 20 | (col + (1 << 16));
+
+    if (key != last_key_) {
+        auto iter = tiles_.find(key);
+        if (iter == tiles_.end()) {
+            iter = tiles_.emplace(key, LocalProjector((row + 0.5) * TILE_DEGREES, (col + 0.5) * TILE_DEGREES, zone_)).first;
+        }
+        last_key_ = key;
+        last_ = &iter->second;
+    }
+
+    last_->forward(lat, lon, x, y);
+}
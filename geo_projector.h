@@ -0,0 +1,60 @@
+#ifndef GEO_PROJECTOR_H
+#define GEO_PROJECTOR_H
+
+#include <cstdint>
+#include <unordered_map>
+
+/**
+ * @brief Second-order Taylor expansion of UTM Forward around one point.
+ *
+ * The coefficients are taken from GeographicLib once, by central differences, so a
+ * projection afterwards is a handful of multiply-adds. Within a couple of
+ * kilometres of the origin the error is well under a centimetre; max_error()
+ * measures it.
+ */
+class LocalProjector {
+public:
+    LocalProjector() = default;
+    LocalProjector(double lat0, double lon0, int zone);
+
+    void forward(double lat, double lon, double& x, double& y) const;
+
+    // Largest distance to UTMUPS::Forward over points within radius metres, in metres.
+    double max_error(double radius) const;
+
+    double latitude() const;
+    double longitude() const;
+
+private:
+    double lat0_ = 0;
+    double lon0_ = 0;
+    int zone_ = 0;
+
+    // x = x_[0] + x_[1] dlon + x_[2] dlat + x_[3] dlon^2 + x_[4] dlon dlat + x_[5] dlat^2, in degrees.
+    double x_[6] = { 0 };
+    double y_[6] = { 0 };
+};
+
+/**
+ * @brief UTM Forward for any point, from LocalProjectors cached per 0.02 degree tile.
+ *
+ * Participants cluster on a few road segments, so nearly every call hits the tile
+ * of the previous one. Not thread safe; keep one per thread.
+ */
+class UtmProjector {
+public:
+    explicit UtmProjector(int zone);
+
+    void forward(double lat, double lon, double& x, double& y);
+
+private:
+    int zone_;
+    std::unordered_map<int64_t, LocalProjector> tiles_;
+    int64_t last_key_ = -1;
+    const LocalProjector* last_ = nullptr;
+};
+
+// The UTM zone every position in ptzctl is expressed in (--utm_zone).
+int utm_zone();
+
+#endif // GEO_PROJECTOR_H
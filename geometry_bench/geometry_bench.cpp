@@ -0,0 +1,117 @@
+/**
+ * @brief Single-core throughput of the batch geometry kernel.
+ *
+ * Times, over the same random targets around one camera: the per-target
+ * hypot/asin code the kernel replaced, the kernel's scalar path and the dispatched
+ * kernel (AVX2 where available). Checks first that the three agree.
+ */
+#include "../geometry_kernel.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+DEFINE_int32(targets, 512, "Targets per batch");
+DEFINE_int32(rounds, 20000, "Batches per variant");
+DEFINE_double(range, 800, "Targets are spread over +-range metres around the camera");
+
+namespace {
+
+// The per-target evaluation on_receive_vehicles and get_needed_ptz used to do.
+void reference(const geometry::Camera& camera, const double* x, const double* y, const double* vx, const double* vy,
+    size_t n, const geometry::Output& out)
+{
+    const double pi = 3.141592654;
+    for (size_t i = 0; i < n; ++i) {
+        const double dx = x[i] - camera.x;
+        const double dy = y[i] - camera.y;
+        out.dist[i] = std::hypot(dx, dy);
+        out.approach[i] = dx * vx[i] + dy * vy[i];
+
+        const double dh = camera.z - std::copysign(out.dist[i], out.approach[i]) * camera.tan_slope;
+        const double dis_3 = std::sqrt(dx * dx + dy * dy + dh * dh);
+        if (out.dist[i] < 1e-6 || dis_3 < 1e-6) {
+            out.pan[i] = NAN;
+            out.tilt[i] = NAN;
+            continue;
+        }
+
+        const double theta = std::asin(dy / out.dist[i]) * 180 / pi;
+        out.pan[i] = dx > 0 ? (90 - theta) : 360 - (90 - theta);
+        out.tilt[i] = std::asin(dh / dis_3) * 180 / pi;
+    }
+}
+
+using Kernel = void (*)(const geometry::Camera&, const double*, const double*, const double*, const double*, size_t, const geometry::Output&);
+
+double run(const char* name, Kernel kernel, const geometry::Camera& camera, geometry::Batch& batch)
+{
+    const size_t n = batch.x.size();
+    const geometry::Output out { batch.dist.data(), batch.approach.data(), batch.pan.data(), batch.tilt.data() };
+
+    double sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < FLAGS_rounds; ++r) {
+        kernel(camera, batch.x.data(), batch.y.data(), batch.vx.data(), batch.vy.data(), n, out);
+        sink += batch.pan[r % n];
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const double rate = static_cast<double>(n) * FLAGS_rounds / secs;
+    printf("%-10s %8.2f Mtargets/s %8.2f ns/target (%g)\n", name, rate / 1e6, 1e9 / rate, sink);
+    return rate;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    const geometry::Camera camera { 448709.0, 4416830.0, 12.0, std::tan(2.0 / 180 * M_PI) };
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> offset(-FLAGS_range, FLAGS_range);
+    std::uniform_real_distribution<double> speed(-30, 30);
+
+    geometry::Batch batch;
+    batch.resize(FLAGS_targets);
+    for (int i = 0; i < FLAGS_targets; ++i) {
+        batch.x[i] = camera.x + offset(rng);
+        batch.y[i] = camera.y + offset(rng);
+        batch.vx[i] = speed(rng);
+        batch.vy[i] = speed(rng);
+    }
+
+    // Agreement: the kernel against the old formulas, and its two paths against each other.
+    geometry::Batch ref = batch;
+    geometry::Batch scalar = batch;
+    reference(camera, ref.x.data(), ref.y.data(), ref.vx.data(), ref.vy.data(), ref.x.size(),
+        geometry::Output { ref.dist.data(), ref.approach.data(), ref.pan.data(), ref.tilt.data() });
+    geometry::compute_scalar(camera, scalar.x.data(), scalar.y.data(), scalar.vx.data(), scalar.vy.data(), scalar.x.size(),
+        geometry::Output { scalar.dist.data(), scalar.approach.data(), scalar.pan.data(), scalar.tilt.data() });
+    batch.compute(camera);
+    geometry::Batch distance = batch;
+    distance.compute_distance(camera);
+
+    double worst = 0;
+    for (int i = 0; i < FLAGS_targets; ++i) {
+        CHECK(batch.pan[i] == scalar.pan[i] && batch.tilt[i] == scalar.tilt[i]) << "scalar and SIMD paths disagree at " << i;
+        CHECK(batch.dist[i] == distance.dist[i] && batch.approach[i] == distance.approach[i]) << "distance-only mode disagrees at " << i;
+        const double dp = std::fabs(batch.pan[i] - ref.pan[i]);
+        worst = std::max({ worst, std::min(dp, 360 - dp), std::fabs(batch.tilt[i] - ref.tilt[i]) });
+    }
+    printf("avx2:%d targets:%d worst deviation from the old formulas: %.2e degree\n", geometry::has_avx2(), FLAGS_targets, worst);
+
+    const double base = run("reference", reference, camera, batch);
+    run("scalar", geometry::compute_scalar, camera, batch);
+    const double fast = run("kernel", geometry::compute, camera, batch);
+    printf("kernel speedup over reference: %.2fx\n", fast / base);
+
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include "geometry_kernel.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEOMETRY_X86 1
+#endif
+
+namespace geometry {
+
+namespace {
+
+    // Cephes atan: range reduction plus a rational approximation, good to about 1e-16.
+    const double T3P8 = 2.41421356237309504880; // tan(3pi/8)
+    const double REDUCE = 0.66;
+    const double PIO2 = 1.57079632679489661923;
+    const double PIO4 = 0.78539816339744830962;
+    const double PI = 3.14159265358979323846;
+    const double DEGREE = 180.0 / PI;
+    const double UNDER_CAMERA = 1e-6;
+
+    const double P0 = -8.750608600031904122785e-01;
+    const double P1 = -1.615753718733365076637e+01;
+    const double P2 = -7.500855792314704667340e+01;
+    const double P3 = -1.228866684490136173410e+02;
+    const double P4 = -6.485021904942025371773e+01;
+    const double Q0 = 2.485846490142306297962e+01;
+    const double Q1 = 1.650270098316988542046e+02;
+    const double Q2 = 4.328810604912902668951e+02;
+    const double Q3 = 4.853903996359136964868e+02;
+    const double Q4 = 1.945506571482613964425e+02;
+
+    // atan(t) for t >= 0, including +inf.
+    inline double atan_positive(double t)
+    {
+        double base = 0;
+        double u = t;
+        if (t > T3P8) {
+            base = PIO2;
+            u = -1.0 / t;
+        } else if (t > REDUCE) {
+            base = PIO4;
+            u = (t - 1.0) / (t + 1.0);
+        }
+
+        const double z = u * u;
+        const double p = (((P0 * z + P1) * z + P2) * z + P3) * z + P4;
+        const double q = ((((z + Q0) * z + Q1) * z + Q2) * z + Q3) * z + Q4;
+        return base + (u * ((z * p) / q) + u);
+    }
+
+    inline void distance_one(const Camera& camera, double x, double y, double vx, double vy, double& dist, double& approach)
+    {
+        const double dx = x - camera.x;
+        const double dy = y - camera.y;
+        dist = std::sqrt(dx * dx + dy * dy);
+        approach = dx * vx + dy * vy;
+    }
+
+    inline void compute_one(const Camera& camera, double x, double y, double vx, double vy,
+        double& dist, double& approach, double& pan, double& tilt)
+    {
+        distance_one(camera, x, y, vx, vy, dist, approach);
+
+        const double dx = x - camera.x;
+        const double dy = y - camera.y;
+        const double dh = camera.z - std::copysign(dist, approach) * camera.tan_slope;
+        if (!(dist >= UNDER_CAMERA)) {
+            pan = NAN;
+            tilt = NAN;
+            return;
+        }
+
+        const double a = atan_positive(std::fabs(dx) / std::fabs(dy));
+        double p = 0;
+        if (dx > 0) {
+            p = dy >= 0 ? a : PI - a;
+        } else {
+            p = dy < 0 ? PI + a : 2 * PI - a;
+        }
+        pan = p * DEGREE;
+
+        const double t = atan_positive(std::fabs(dh) / dist) * DEGREE;
+        tilt = dh < 0 ? -t : t;
+    }
+
+#ifdef GEOMETRY_X86
+    __attribute__((target("avx2"))) inline __m256d atan_positive(__m256d t)
+    {
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d far = _mm256_cmp_pd(t, _mm256_set1_pd(T3P8), _CMP_GT_OQ);
+        const __m256d mid = _mm256_andnot_pd(far, _mm256_cmp_pd(t, _mm256_set1_pd(REDUCE), _CMP_GT_OQ));
+
+        __m256d base = _mm256_setzero_pd();
+        base = _mm256_blendv_pd(base, _mm256_set1_pd(PIO4), mid);
+        base = _mm256_blendv_pd(base, _mm256_set1_pd(PIO2), far);
+
+        __m256d u = t;
+        u = _mm256_blendv_pd(u, _mm256_div_pd(_mm256_sub_pd(t, one), _mm256_add_pd(t, one)), mid);
+        u = _mm256_blendv_pd(u, _mm256_div_pd(_mm256_set1_pd(-1.0), t), far);
+
+        const __m256d z = _mm256_mul_pd(u, u);
+        __m256d p = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(P0), z), _mm256_set1_pd(P1));
+        p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(P2));
+        p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(P3));
+        p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(P4));
+        __m256d q = _mm256_add_pd(z, _mm256_set1_pd(Q0));
+        q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(Q1));
+        q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(Q2));
+        q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(Q3));
+        q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(Q4));
+
+        const __m256d r = _mm256_add_pd(_mm256_mul_pd(u, _mm256_div_pd(_mm256_mul_pd(z, p), q)), u);
+        return _mm256_add_pd(base, r);
+    }
+
+    __attribute__((target("avx2"))) size_t compute_avx2(const Camera& camera, const double* x, const double* y,
+        const double* vx, const double* vy, size_t n, const Output& out)
+    {
+        const __m256d cx = _mm256_set1_pd(camera.x);
+        const __m256d cy = _mm256_set1_pd(camera.y);
+        const __m256d cz = _mm256_set1_pd(camera.z);
+        const __m256d slope = _mm256_set1_pd(camera.tan_slope);
+        const __m256d sign_bit = _mm256_set1_pd(-0.0);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d pi = _mm256_set1_pd(PI);
+        const __m256d two_pi = _mm256_set1_pd(2 * PI);
+        const __m256d degree = _mm256_set1_pd(DEGREE);
+        const __m256d nan = _mm256_set1_pd(NAN);
+        const bool angles = out.pan != nullptr;
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i), cx);
+            const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i), cy);
+            const __m256d dist = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+            const __m256d approach = _mm256_add_pd(_mm256_mul_pd(dx, _mm256_loadu_pd(vx + i)), _mm256_mul_pd(dy, _mm256_loadu_pd(vy + i)));
+            _mm256_storeu_pd(out.dist + i, dist);
+            _mm256_storeu_pd(out.approach + i, approach);
+            if (!angles) {
+                continue;
+            }
+
+            const __m256d signed_dist = _mm256_or_pd(_mm256_andnot_pd(sign_bit, dist), _mm256_and_pd(sign_bit, approach));
+            const __m256d dh = _mm256_sub_pd(cz, _mm256_mul_pd(signed_dist, slope));
+
+            const __m256d a = atan_positive(_mm256_div_pd(_mm256_andnot_pd(sign_bit, dx), _mm256_andnot_pd(sign_bit, dy)));
+            const __m256d east = _mm256_cmp_pd(dx, zero, _CMP_GT_OQ);
+            const __m256d north = _mm256_cmp_pd(dy, zero, _CMP_GE_OQ);
+            const __m256d east_pan = _mm256_blendv_pd(_mm256_sub_pd(pi, a), a, north);
+            const __m256d west_pan = _mm256_blendv_pd(_mm256_sub_pd(two_pi, a), _mm256_add_pd(pi, a), _mm256_cmp_pd(dy, zero, _CMP_LT_OQ));
+            __m256d pan = _mm256_mul_pd(_mm256_blendv_pd(west_pan, east_pan, east), degree);
+
+            const __m256d t = _mm256_mul_pd(atan_positive(_mm256_div_pd(_mm256_andnot_pd(sign_bit, dh), dist)), degree);
+            __m256d tilt = _mm256_blendv_pd(t, _mm256_xor_pd(t, sign_bit), _mm256_cmp_pd(dh, zero, _CMP_LT_OQ));
+
+            const __m256d under = _mm256_cmp_pd(dist, _mm256_set1_pd(UNDER_CAMERA), _CMP_NGE_UQ);
+            pan = _mm256_blendv_pd(pan, nan, under);
+            tilt = _mm256_blendv_pd(tilt, nan, under);
+
+            _mm256_storeu_pd(out.pan + i, pan);
+            _mm256_storeu_pd(out.tilt + i, tilt);
+        }
+        return i;
+    }
+#endif
+
+    void compute_tail(const Camera& camera, const double* x, const double* y, const double* vx, const double* vy,
+        size_t begin, size_t n, const Output& out)
+    {
+        if (out.pan == nullptr) {
+            for (size_t i = begin; i < n; ++i) {
+                distance_one(camera, x[i], y[i], vx[i], vy[i], out.dist[i], out.approach[i]);
+            }
+            return;
+        }
+
+        for (size_t i = begin; i < n; ++i) {
+            compute_one(camera, x[i], y[i], vx[i], vy[i], out.dist[i], out.approach[i], out.pan[i], out.tilt[i]);
+        }
+    }
+
+} // namespace
+
+bool has_avx2()
+{
+#ifdef GEOMETRY_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+void compute(const Camera& camera, const double* x, const double* y, const double* vx, const double* vy,
+    size_t n, const Output& out)
+{
+    size_t done = 0;
+#ifdef GEOMETRY_X86
+    if (has_avx2()) {
+        done = compute_avx2(camera, x, y, vx, vy, n, out);
+    }
+#endif
+    compute_tail(camera, x, y, vx, vy, done, n, out);
+}
+
+void compute_scalar(const Camera& camera, const double* x, const double* y, const double* vx, const double* vy,
+    size_t n, const Output& out)
+{
+    compute_tail(camera, x, y, vx, vy, 0, n, out);
+}
+
+bool pan_tilt(double dx, double dy, double dh, double& pan, double& tilt)
+{
+    // A camera at the origin, flat road, target dh below: same path as the batch.
+    const Camera camera { 0, 0, dh, 0 };
+    double dist = 0, approach = 0, p = 0, t = 0;
+    compute_one(camera, dx, dy, 0, 0, dist, approach, p, t);
+    if (std::isnan(p)) {
+        return false;
+    }
+
+    pan = p;
+    tilt = t;
+    return true;
+}
+
+void Batch::resize(size_t n)
+{
+    for (auto* v : { &x, &y, &vx, &vy, &dist, &approach, &pan, &tilt }) {
+        v->resize(n);
+    }
+}
+
+void Batch::compute(const Camera& camera)
+{
+    geometry::compute(camera, x.data(), y.data(), vx.data(), vy.data(), x.size(),
+        Output { dist.data(), approach.data(), pan.data(), tilt.data() });
+}
+
+void Batch::compute_distance(const Camera& camera)
+{
+    geometry::compute(camera, x.data(), y.data(), vx.data(), vy.data(), x.size(),
+        Output { dist.data(), approach.data(), nullptr, nullptr });
+}
+
+} // namespace geometry
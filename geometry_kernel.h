@@ -0,0 +1,66 @@
+#ifndef GEOMETRY_KERNEL_H
+#define GEOMETRY_KERNEL_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Batch camera-to-target geometry over structure-of-arrays input.
+ *
+ * For each target: ground distance to the camera, approach sign (the dot product of
+ * offset and velocity, negative while coming closer) and the pan/tilt
+ * PtzController::get_needed_ptz would ask for, with the target height raised by the
+ * camera's road slope as on_vehicle_detected does. Uses AVX2 when the CPU has it and
+ * a scalar loop otherwise; both evaluate the same operations in the same order, so
+ * they agree to the last bit.
+ */
+namespace geometry {
+
+struct Camera {
+    double x;
+    double y;
+    double z;
+    double tan_slope; // tan(slope), 0 for a flat road
+};
+
+struct Output {
+    double* dist;
+    double* approach;
+    double* pan; // degree, NAN when the target is under the camera; nullptr skips pan and tilt
+    double* tilt; // degree, NAN when the target is under the camera
+};
+
+void compute(const Camera& camera, const double* x, const double* y, const double* vx, const double* vy,
+    size_t n, const Output& out);
+
+// The scalar path only, for benchmarks.
+void compute_scalar(const Camera& camera, const double* x, const double* y, const double* vx, const double* vy,
+    size_t n, const Output& out);
+
+// Pan/tilt towards an offset (dx, dy) with the camera dh above the target. False,
+// leaving pan and tilt alone, when the target is right under the camera.
+bool pan_tilt(double dx, double dy, double dh, double& pan, double& tilt);
+
+bool has_avx2();
+
+// Reusable input and output buffers, for targets gathered from a larger frame.
+struct Batch {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> vx;
+    std::vector<double> vy;
+    std::vector<double> dist;
+    std::vector<double> approach;
+    std::vector<double> pan;
+    std::vector<double> tilt;
+
+    void resize(size_t n);
+    void compute(const Camera& camera);
+
+    // Distance and approach only, leaving pan and tilt stale.
+    void compute_distance(const Camera& camera);
+};
+
+} // namespace geometry
+
+#endif // GEOMETRY_KERNEL_H
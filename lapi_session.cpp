@@ -0,0 +1,73 @@
+#include "lapi_session.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+DEFINE_int32(camera_connect_timeout_ms, 2000, "Connect timeout of camera HTTP sessions");
+DEFINE_int32(camera_read_timeout_ms, 3000, "Read/write timeout of camera HTTP sessions");
+
+LapiSession::LapiSession(const std::string& addr, int port, std::string user, std::string pswd)
+    : user_(std::move(user))
+    , pswd_(std::move(pswd))
+    , cli_(addr, port)
+{
+    cli_.set_keep_alive(true);
+    cli_.set_tcp_nodelay(true);
+    cli_.set_connection_timeout(std::chrono::milliseconds(FLAGS_camera_connect_timeout_ms));
+    cli_.set_read_timeout(std::chrono::milliseconds(FLAGS_camera_read_timeout_ms));
+    cli_.set_write_timeout(std::chrono::milliseconds(FLAGS_camera_read_timeout_ms));
+}
+
+httplib::Result LapiSession::get(const std::string& path)
+{
+    return request("GET", path, "");
+}
+
+httplib::Result LapiSession::put(const std::string& path, const std::string& body)
+{
+    return request("PUT", path, body);
+}
+
+httplib::Result LapiSession::request(const std::string& method, const std::string& path, const std::string& body)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto res = send(method, path, body);
+    const bool unreachable = !res && (res.error() == httplib::Error::Connection || res.error() == httplib::Error::ConnectionTimeout);
+    if (!res && !unreachable) {
+        // The camera closed the idle connection, the client reconnects on the next send.
+        // A camera that cannot be connected to at all is not tried twice.
+        VLOG(3) << "LAPI connection lost: " << httplib::to_string(res.error()) << ", reconnecting";
+        res = send(method, path, body);
+    }
+
+    if (res && res->status == 401) {
+        std::map<std::string, std::string> auth;
+        if (!httplib::detail::parse_www_authenticate(res.value(), auth, false)) {
+            return res;
+        }
+        challenge_ = std::move(auth);
+        nonce_count_ = 0;
+        res = send(method, path, body);
+    }
+
+    return res;
+}
+
+httplib::Result LapiSession::send(const std::string& method, const std::string& path, const std::string& body)
+{
+    httplib::Request req;
+    req.method = method;
+    req.path = path;
+    req.body = body;
+    if (!body.empty()) {
+        req.headers.emplace("Content-Type", "text/plain");
+    }
+
+    if (!challenge_.empty()) {
+        req.headers.insert(httplib::detail::make_digest_authentication_header(
+            req, challenge_, ++nonce_count_, httplib::detail::random_string(10), user_, pswd_));
+    }
+
+    return cli_.send(req);
+}
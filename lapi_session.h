@@ -0,0 +1,43 @@
+#ifndef LAPI_SESSION_H
+#define LAPI_SESSION_H
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib.h"
+
+#include <base/Noncopyable.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief A long-lived keep-alive HTTP session to one LAPI camera.
+ *
+ * The digest challenge is cached after the first 401, so later requests carry
+ * the Authorization header up front with an incrementing nonce-count instead of
+ * paying a challenge round trip each time. A stale nonce (401 again) refreshes
+ * the challenge, a dropped connection is re-established and the request resent once.
+ * A failed connect is returned as is, retrying is left to the caller's circuit breaker.
+ */
+class LapiSession : public afl::Noncopyable {
+public:
+    LapiSession(const std::string& addr, int port, std::string user, std::string pswd);
+
+    httplib::Result get(const std::string& path);
+    httplib::Result put(const std::string& path, const std::string& body = "");
+
+private:
+    httplib::Result request(const std::string& method, const std::string& path, const std::string& body);
+    httplib::Result send(const std::string& method, const std::string& path, const std::string& body);
+
+private:
+    std::string user_;
+    std::string pswd_;
+
+    std::mutex mutex_;
+    httplib::Client cli_;
+    std::map<std::string, std::string> challenge_;
+    size_t nonce_count_ = 0;
+};
+
+#endif // LAPI_SESSION_H
@@ -0,0 +1,86 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr int LatencyHistogram::SUB_BITS;
+constexpr int64_t LatencyHistogram::SUB_COUNT;
+constexpr int LatencyHistogram::MAX_MAGNITUDE;
+constexpr int LatencyHistogram::BUCKETS;
+
+LatencyHistogram::LatencyHistogram()
+{
+    for (auto& b : buckets_) {
+        b.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucket_of(int64_t us)
+{
+    const uint64_t v = static_cast<uint64_t>(std::max<int64_t>(us, 0));
+    if (v < static_cast<uint64_t>(SUB_COUNT)) {
+        return static_cast<int>(v);
+    }
+
+    const int magnitude = std::min(63 - __builtin_clzll(v), MAX_MAGNITUDE);
+    const int shift = magnitude - SUB_BITS;
+    const int64_t sub = std::min<int64_t>(static_cast<int64_t>(v >> shift), 2 * SUB_COUNT - 1);
+    return static_cast<int>((shift + 1) * SUB_COUNT + (sub - SUB_COUNT));
+}
+
+int64_t LatencyHistogram::lower_bound_of(int bucket)
+{
+    if (bucket < SUB_COUNT) {
+        return bucket;
+    }
+
+    const int shift = bucket / SUB_COUNT - 1;
+    return (bucket % SUB_COUNT + SUB_COUNT) << shift;
+}
+
+void LatencyHistogram::record(int64_t us)
+{
+    buckets_[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t max = max_.load(std::memory_order_relaxed);
+    while (us > max && !max_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return count_.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::max() const
+{
+    return max_.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::percentile(double q) const
+{
+    const uint64_t total = count();
+    if (0 == total) {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * total)));
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; ++b) {
+        seen += buckets_[b].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return lower_bound_of(b);
+        }
+    }
+    return max();
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto& b : buckets_) {
+        b.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,43 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Log-linear (HDR style) histogram of microsecond latencies.
+ *
+ * Each power of two is split into 32 linear sub-buckets, so any recorded value is
+ * reported within about 3%, from 1 us up to about 12 days. Recording takes two
+ * relaxed atomic increments (bucket and count) plus a compare-exchange loop that
+ * only spins while the value raises the max; it is lock free and safe from any thread.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(int64_t us);
+
+    uint64_t count() const;
+    int64_t max() const;
+    // q in [0, 1]; the lower bound of the bucket holding the q-th value, 0 if empty.
+    int64_t percentile(double q) const;
+
+    void reset();
+
+private:
+    static constexpr int SUB_BITS = 5;
+    static constexpr int64_t SUB_COUNT = 1 << SUB_BITS;
+    static constexpr int MAX_MAGNITUDE = 40;
+    static constexpr int BUCKETS = (MAX_MAGNITUDE - SUB_BITS + 2) * SUB_COUNT;
+
+    static int bucket_of(int64_t us);
+    static int64_t lower_bound_of(int bucket);
+
+private:
+    std::atomic<uint64_t> buckets_[BUCKETS];
+    std::atomic<uint64_t> count_ { 0 };
+    std::atomic<int64_t> max_ { 0 };
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,338 @@
+/**
+ * @brief Publishes synthetic participant frames and radar events for scale testing.
+ *
+ * Vehicles drive both ways along a road laid through the camera positions of the
+ * config, in lanes, at random speeds. Every --fps tick all of them go out as one
+ * ParticipantInfos on algoTargetTopic; events go out on receivedRadarEventsTopic.
+ * Point ptzctl at the same endpoints and raise --vehicles or the camera count until
+ * it falls behind.
+ */
+#include "../geo_projector.h"
+#include "../read_config.h"
+
+#include <GeographicLib/UTMUPS.hpp>
+#include <common/appprotocol.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <ihspb/pub-sub.pb.h>
+#include <mmw/mmwfactory.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+DEFINE_string(target_addr, algoResultPublisherAddr, "Endpoint the participant frames are published on");
+DEFINE_string(event_addr, sensorPublisherAddr, "Endpoint the radar events are published on");
+
+DEFINE_int32(vehicles, 300, "Vehicles on the road at any time, i.e. participants per frame");
+DEFINE_double(fps, 10, "Frames per second");
+DEFINE_double(duration, 0, "Seconds to run, 0 for ever");
+DEFINE_int32(latency_ms, 100, "Participant timestamps lag the publish time by this much, like a real sensor");
+
+DEFINE_double(road_extend, 500, "Meters the road runs on past the first and the last camera");
+DEFINE_int32(lanes, 2, "Lanes per direction");
+DEFINE_double(lane_width, 3.5, "Meters");
+DEFINE_double(speed_min, 10, "Vehicle speed range, m/s");
+DEFINE_double(speed_max, 30, "Vehicle speed range, m/s");
+
+DEFINE_double(plate_ratio, 0.7, "Share of vehicles with a recognized plate");
+DEFINE_int32(plate_pool, 10000, "Plates are drawn from this many distinct ones, so some repeat");
+DEFINE_string(plates, "", "Comma separated plates that are always on the road, to test focus matching");
+
+DEFINE_double(event_interval, 0, "Seconds between radar events at random places on the road, 0 for none");
+DEFINE_int32(event_type, 1, "eventType of the published events");
+
+DEFINE_double(stats_interval, 10, "Seconds between rate reports");
+DEFINE_int32(seed, 1, "Random seed");
+
+namespace {
+
+/**
+ * The road: a polyline through the cameras, ordered along the direction in which they
+ * are spread widest, with FLAGS_road_extend added at both ends.
+ */
+class Road {
+public:
+    explicit Road(std::vector<std::pair<double, double>> points)
+    {
+        LOG_IF(FATAL, points.empty()) << "no cameras in the config";
+
+        // Order along the pair of cameras furthest apart; a single camera gets an east-west road.
+        double ux = 1, uy = 0, widest = 0;
+        for (const auto& a : points) {
+            for (const auto& b : points) {
+                const double d = std::hypot(b.first - a.first, b.second - a.second);
+                if (d > widest) {
+                    widest = d;
+                    ux = (b.first - a.first) / d;
+                    uy = (b.second - a.second) / d;
+                }
+            }
+        }
+        std::sort(points.begin(), points.end(), [&](const std::pair<double, double>& a, const std::pair<double, double>& b) {
+            return a.first * ux + a.second * uy < b.first * ux + b.second * uy;
+        });
+        points.erase(std::unique(points.begin(), points.end()), points.end());
+
+        const auto& first = points.front();
+        const auto& last = points.back();
+        const auto head = points.size() > 1 ? direction(points[0], points[1]) : std::make_pair(ux, uy);
+        const auto tail = points.size() > 1 ? direction(points[points.size() - 2], last) : std::make_pair(ux, uy);
+        points_.emplace_back(first.first - head.first * FLAGS_road_extend, first.second - head.second * FLAGS_road_extend);
+        points_.insert(points_.end(), points.begin(), points.end());
+        points_.emplace_back(last.first + tail.first * FLAGS_road_extend, last.second + tail.second * FLAGS_road_extend);
+
+        length_.push_back(0);
+        for (size_t i = 1; i < points_.size(); ++i) {
+            length_.push_back(length_.back() + std::hypot(points_[i].first - points_[i - 1].first, points_[i].second - points_[i - 1].second));
+        }
+    }
+
+    double length() const
+    {
+        return length_.back();
+    }
+
+    // Position at distance s along the road and the unit direction of travel there.
+    void at(double s, double& x, double& y, double& tx, double& ty) const
+    {
+        s = std::min(std::max(s, 0.0), length());
+        size_t i = std::upper_bound(length_.begin(), length_.end(), s) - length_.begin();
+        i = std::min(std::max<size_t>(i, 1), points_.size() - 1);
+        const auto& a = points_[i - 1];
+        const auto& b = points_[i];
+        const double segment = length_[i] - length_[i - 1];
+        const double f = segment > 0 ? (s - length_[i - 1]) / segment : 0;
+        std::tie(tx, ty) = direction(a, b);
+        x = a.first + (b.first - a.first) * f;
+        y = a.second + (b.second - a.second) * f;
+    }
+
+private:
+    static std::pair<double, double> direction(const std::pair<double, double>& a, const std::pair<double, double>& b)
+    {
+        const double d = std::hypot(b.first - a.first, b.second - a.second);
+        return d > 0 ? std::make_pair((b.first - a.first) / d, (b.second - a.second) / d) : std::make_pair(1.0, 0.0);
+    }
+
+    std::vector<std::pair<double, double>> points_;
+    std::vector<double> length_; // cumulative, length_[i] is the distance to points_[i]
+};
+
+struct Vehicle {
+    uint64_t ptcid;
+    double s; // distance along the road
+    int dir; // +1 along the road, -1 against it
+    int lane;
+    double speed;
+    std::string plate;
+    bool fixed_plate; // one of --plates, kept on respawn
+};
+
+class Traffic {
+public:
+    Traffic(const Road& road, std::vector<std::string> plates)
+        : road_(road)
+        , rng_(FLAGS_seed)
+    {
+        std::uniform_real_distribution<double> anywhere(0, road_.length());
+        for (int i = 0; i < FLAGS_vehicles; ++i) {
+            Vehicle v;
+            v.fixed_plate = static_cast<size_t>(i) < plates.size();
+            spawn(v);
+            v.s = anywhere(rng_);
+            if (v.fixed_plate) {
+                v.plate = plates[i];
+            }
+            vehicles_.push_back(v);
+        }
+        LOG_IF(WARNING, plates.size() > vehicles_.size()) << "more --plates than --vehicles, the rest are not on the road";
+    }
+
+    // Moves every vehicle dt seconds on; the ones leaving the road come back in at its start as new participants.
+    void step(double dt)
+    {
+        for (auto& v : vehicles_) {
+            v.s += v.dir * v.speed * dt;
+            if (v.s < 0 || v.s > road_.length()) {
+                spawn(v);
+            }
+        }
+    }
+
+    void fill(v2x::ParticipantInfos& infos, uint64_t timestamp_ms) const
+    {
+        infos.Clear();
+        for (const auto& v : vehicles_) {
+            double x = 0, y = 0, tx = 0, ty = 0;
+            road_.at(v.s, x, y, tx, ty);
+            // Right-hand traffic: lanes of each direction sit to its right of the center line.
+            const double offset = (v.lane + 0.5) * FLAGS_lane_width * v.dir;
+            x += ty * offset;
+            y -= tx * offset;
+
+            double lat = 0, lon = 0;
+            GeographicLib::UTMUPS::Reverse(utm_zone(), true, x, y, lat, lon);
+
+            auto* ptc = infos.add_participants();
+            ptc->set_ptcid(v.ptcid);
+            ptc->set_latitude(lat);
+            ptc->set_longitude(lon);
+            ptc->set_speedx(tx * v.speed * v.dir);
+            ptc->set_speedy(ty * v.speed * v.dir);
+            ptc->set_timestamp(timestamp_ms);
+            if (!v.plate.empty()) {
+                ptc->set_plate(v.plate);
+            }
+        }
+    }
+
+    void random_event(v2x::EventInfos& events)
+    {
+        double x = 0, y = 0, tx = 0, ty = 0;
+        road_.at(std::uniform_real_distribution<double>(0, road_.length())(rng_), x, y, tx, ty);
+        double lat = 0, lon = 0;
+        GeographicLib::UTMUPS::Reverse(utm_zone(), true, x, y, lat, lon);
+
+        events.Clear();
+        auto* event = events.add_ihstrafficeventlist();
+        event->set_eventtype(FLAGS_event_type);
+        event->set_latitude(lat);
+        event->set_longitude(lon);
+    }
+
+private:
+    void spawn(Vehicle& v)
+    {
+        v.ptcid = next_ptcid_++;
+        v.dir = std::bernoulli_distribution(0.5)(rng_) ? 1 : -1;
+        v.s = v.dir > 0 ? 0 : road_.length();
+        v.lane = std::uniform_int_distribution<int>(0, std::max(FLAGS_lanes, 1) - 1)(rng_);
+        v.speed = std::uniform_real_distribution<double>(FLAGS_speed_min, std::max(FLAGS_speed_min, FLAGS_speed_max))(rng_);
+        if (v.fixed_plate) {
+            return;
+        }
+        v.plate.clear();
+        if (std::bernoulli_distribution(FLAGS_plate_ratio)(rng_)) {
+            char plate[16];
+            snprintf(plate, sizeof(plate), "京A%05d", std::uniform_int_distribution<int>(0, std::max(FLAGS_plate_pool, 1) - 1)(rng_));
+            v.plate = plate;
+        }
+    }
+
+    const Road& road_;
+    std::mt19937 rng_;
+    std::vector<Vehicle> vehicles_;
+    uint64_t next_ptcid_ = 1;
+};
+
+std::vector<std::string> split_plates(const std::string& list)
+{
+    std::vector<std::string> plates;
+    std::stringstream ss(list);
+    std::string plate;
+    while (std::getline(ss, plate, ',')) {
+        if (!plate.empty()) {
+            plates.push_back(plate);
+        }
+    }
+    return plates;
+}
+
+std::shared_ptr<afl::PublisherAbstract> make_publisher(const std::string& addr)
+{
+    auto publisher = afl::MMWFactory().getPublisher(afl::MMWSelector::ZMQ, addr);
+    LOG_IF(FATAL, publisher == nullptr) << "This MQ type is not supported!";
+    LOG_IF(FATAL, publisher->init() == false) << "publisher " << addr << " init return false!";
+    return publisher;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    LOG_IF(FATAL, FLAGS_fps <= 0) << "--fps must be positive";
+
+    std::vector<std::pair<double, double>> cameras;
+    for (const auto& c : ReadConfig::getInstance().config().cameras) {
+        cameras.emplace_back(c.x, c.y);
+    }
+    Road road(cameras);
+    Traffic traffic(road, split_plates(FLAGS_plates));
+    LOG(INFO) << "road through " << cameras.size() << " cameras, " << road.length() << "m, "
+              << FLAGS_vehicles << " vehicles at " << FLAGS_fps << " fps";
+
+    auto targets = make_publisher(FLAGS_target_addr);
+    auto events = FLAGS_event_interval > 0 ? make_publisher(FLAGS_event_addr) : nullptr;
+
+    using Clock = std::chrono::steady_clock;
+    const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / FLAGS_fps));
+    const auto start = Clock::now();
+    auto next_frame = start;
+    auto next_event = start;
+    auto next_stats = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(FLAGS_stats_interval));
+
+    v2x::ParticipantInfos infos;
+    v2x::EventInfos event_infos;
+    std::string payload;
+    size_t frame_bytes = 0;
+    uint64_t frames = 0, late = 0, event_count = 0;
+    uint64_t window_frames = 0;
+    double window_busy = 0;
+
+    while (FLAGS_duration <= 0 || Clock::now() - start < std::chrono::duration<double>(FLAGS_duration)) {
+        std::this_thread::sleep_until(next_frame);
+
+        const auto begin = Clock::now();
+        const uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+                                    .count();
+        traffic.fill(infos, now_ms - FLAGS_latency_ms);
+        infos.SerializeToString(&payload);
+        frame_bytes = payload.size();
+        targets->publish(algoTargetTopic, payload.data(), payload.size());
+
+        if (events != nullptr && begin >= next_event) {
+            traffic.random_event(event_infos);
+            event_infos.SerializeToString(&payload);
+            events->publish(receivedRadarEventsTopic, payload.data(), payload.size());
+            ++event_count;
+            next_event += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(FLAGS_event_interval));
+        }
+
+        traffic.step(1.0 / FLAGS_fps);
+        ++frames;
+        ++window_frames;
+        window_busy += std::chrono::duration<double>(Clock::now() - begin).count();
+
+        // Behind schedule: skip the missed ticks instead of bursting to catch up.
+        next_frame += period;
+        if (Clock::now() > next_frame) {
+            ++late;
+            next_frame = Clock::now() + period;
+        }
+
+        if (Clock::now() >= next_stats) {
+            const double window = FLAGS_stats_interval;
+            LOG(INFO) << "frames:" << frames << " fps:" << window_frames / window
+                      << " participants/frame:" << infos.participants_size()
+                      << " bytes/frame:" << frame_bytes
+                      << " build+publish:" << window_busy / std::max<uint64_t>(window_frames, 1) * 1e3 << "ms"
+                      << " late:" << late << " events:" << event_count;
+            window_frames = 0;
+            window_busy = 0;
+            next_stats += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(window));
+        }
+    }
+
+    LOG(INFO) << "sent " << frames << " frames, " << event_count << " events, " << late << " late";
+    return 0;
+}
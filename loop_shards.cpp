@@ -0,0 +1,131 @@
+#include "loop_shards.h"
+
+#include <base/Timestamp.h>
+#include <net/EventLoopThread.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <sstream>
+
+DEFINE_double(shard_probe_interval, 1.0, "interval of the shard lag probe, in seconds");
+
+namespace {
+
+uint64_t fnv1a(const std::string& s)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::vector<int> parse_cpus(const std::string& cpus)
+{
+    std::vector<int> ids;
+    std::stringstream ss(cpus);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            ids.push_back(std::stoi(item));
+        }
+    }
+    return ids;
+}
+
+void pin_current_thread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    LOG_IF(ERROR, ret != 0) << "pin loop thread to cpu " << cpu << " failed:" << ret;
+}
+
+} // namespace
+
+LoopShards::LoopShards(size_t shards, const std::string& cpus)
+{
+    const auto cpu_ids = parse_cpus(cpus);
+
+    for (size_t i = 0; i < shards; ++i) {
+        std::unique_ptr<Shard> shard(new Shard);
+        shard->thread.reset(new afl::net::EventLoopThread);
+
+        // The loop belongs to its thread; the shared_ptr only refers to it.
+        auto& loop = shard->thread->startLoop();
+        shard->loop = std::shared_ptr<afl::net::EventLoop>(std::shared_ptr<void>(), &loop);
+
+        if (!cpu_ids.empty()) {
+            const int cpu = cpu_ids[i % cpu_ids.size()];
+            loop.runInLoop([cpu]() { pin_current_thread(cpu); });
+        }
+
+        Shard* s = shard.get();
+        s->last_probe_us = afl::Timestamp::now().microSecondsSinceEpoch();
+        loop.runEvery(FLAGS_shard_probe_interval, [this, s]() { probe(*s); });
+
+        shards_.push_back(std::move(shard));
+    }
+}
+
+LoopShards::~LoopShards() = default;
+
+size_t LoopShards::size() const
+{
+    return shards_.size();
+}
+
+std::shared_ptr<afl::net::EventLoop> LoopShards::loop_for(const std::string& device_serial)
+{
+    auto& shard = *shards_[shard_of(device_serial)];
+    ++shard.cameras;
+    return shard.loop;
+}
+
+size_t LoopShards::shard_of(const std::string& device_serial) const
+{
+    return fnv1a(device_serial) % shards_.size();
+}
+
+void LoopShards::probe(Shard& shard)
+{
+    const int64_t now = afl::Timestamp::now().microSecondsSinceEpoch();
+    const int64_t lag = now - shard.last_probe_us - static_cast<int64_t>(FLAGS_shard_probe_interval * 1e6);
+    shard.last_probe_us = now;
+
+    int64_t max_lag = shard.max_lag_us;
+    while (lag > max_lag && !shard.max_lag_us.compare_exchange_weak(max_lag, lag)) {
+    }
+}
+
+LoopShards::Stats LoopShards::stats(size_t shard) const
+{
+    const auto& s = *shards_[shard];
+    return Stats { s.cameras, s.window_lag_us / 1000.0 };
+}
+
+std::vector<LoopShards::Stats> LoopShards::stats() const
+{
+    std::vector<Stats> result;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        result.push_back(stats(i));
+    }
+    return result;
+}
+
+void LoopShards::log_stats()
+{
+    for (auto& shard : shards_) {
+        shard->window_lag_us = shard->max_lag_us.exchange(0);
+    }
+
+    const auto all = stats();
+    for (size_t i = 0; i < all.size(); ++i) {
+        LOG(INFO) << "loop shard " << i << " cameras:" << all[i].cameras << " lag_ms:" << all[i].lag_ms;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef LOOP_SHARDS_H
+#define LOOP_SHARDS_H
+
+#include <net/EventLoop.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace afl {
+namespace net {
+    class EventLoopThread;
+}
+}
+
+/**
+ * @brief A fixed set of event-loop threads that ControlContexts are spread over.
+ *
+ * A camera always lands on the same shard (FNV-1a of its device_serial), so a
+ * blocking call on one camera only delays the cameras sharing its shard. Every
+ * shard runs a probe timer; how late it fires is the shard's scheduling lag,
+ * which is the load metric. The worst lag is kept per window, a window being
+ * closed by each log_stats() call.
+ */
+class LoopShards {
+public:
+    struct Stats {
+        size_t cameras;
+        double lag_ms; // worst probe lag in the last closed window
+    };
+
+    // cpus: comma separated cpu ids, shard i is pinned to cpus[i % n]; empty for no pinning.
+    LoopShards(size_t shards, const std::string& cpus);
+    ~LoopShards();
+
+    size_t size() const;
+    std::shared_ptr<afl::net::EventLoop> loop_for(const std::string& device_serial);
+    size_t shard_of(const std::string& device_serial) const;
+
+    // Safe to call from any thread.
+    Stats stats(size_t shard) const;
+    std::vector<Stats> stats() const;
+    // Closes the current lag window and logs every shard.
+    void log_stats();
+
+private:
+    struct Shard {
+        std::unique_ptr<afl::net::EventLoopThread> thread;
+        std::shared_ptr<afl::net::EventLoop> loop;
+        std::atomic<size_t> cameras { 0 };
+        std::atomic<int64_t> max_lag_us { 0 }; // current window
+        std::atomic<int64_t> window_lag_us { 0 }; // last closed window
+        int64_t last_probe_us = 0;
+    };
+
+    void probe(Shard& shard);
+
+private:
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+#endif // LOOP_SHARDS_H
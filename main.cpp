@@ -1,4 +1,5 @@
 #include "control_context.h"
+#include "loop_shards.h"
 #include "mqtt_interactor.h"
 #include "read_config.h"
 #include "zmq_interactor.h"
@@ -13,6 +14,7 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <mutex>
@@ -30,6 +32,10 @@ DEFINE_double(y, 0, "the y value");
 
 DEFINE_string(addr, "tcp://172.18.32.4:1883", "mqtt addr");
 
+DEFINE_int32(loop_shards, 0, "event loop threads the cameras are spread over, 0 runs every camera on the main loop");
+DEFINE_string(loop_cpus, "", "comma separated cpu ids the loop shards are pinned to, empty for no pinning");
+DEFINE_double(shard_stats_interval, 10.0, "window of the loop shard load, logged and published in the camera status, in seconds");
+
 using namespace v2x;
 
 bool check_coord_ptz(const double& x)
@@ -85,6 +91,9 @@ void on_command_mode(std::map<std::string, std::shared_ptr<ControlContext>>& ctx
         iter->second->calibrate(FLAGS_x, FLAGS_y, dp, dt);
         std::cout << "delta P:" << dp << " delta T:" << dt << std::endl;
     }
+
+    // 命令在球机执行队列中异步下发，退出前等待执行完
+    iter->second->wait_idle();
 };
 
 int main(int argc, char** argv)
@@ -109,11 +118,23 @@ int main(int argc, char** argv)
 
     afl::net::EventLoopManager evm;
 
+    // 球机按 device_serial 分片到多个事件循环线程, 命令行模式只用主循环
+    LoopShards shards(cmd_mode ? 0 : std::max(FLAGS_loop_shards, 0), FLAGS_loop_cpus);
+
     // 创建球机控制上下文
     std::map<std::string, std::shared_ptr<ControlContext>> cctx;
     for (auto& c : conf.cameras) {
         auto ptz = std::make_shared<PtzController>(c, conf.pid);
-        cctx[c.device_serial] = std::make_shared<ControlContext>(ptz, zmq, mqtt, evm.getEventLoop());
+        auto loop = shards.size() == 0 ? evm.getEventLoop() : shards.loop_for(c.device_serial);
+        cctx[c.device_serial] = std::make_shared<ControlContext>(ptz, zmq, mqtt, loop);
+        if (shards.size() != 0) {
+            const size_t shard = shards.shard_of(c.device_serial);
+            cctx[c.device_serial]->set_shard_stats(shard, [&shards, shard]() { return shards.stats(shard); });
+        }
+    }
+
+    if (shards.size() != 0) {
+        evm.getEventLoop()->runEvery(FLAGS_shard_stats_interval, [&shards]() { shards.log_stats(); });
     }
 
     // 命令行模式
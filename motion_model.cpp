@@ -0,0 +1,186 @@
+#include "motion_model.h"
+
+#include <glog/logging.h>
+#include <nlohmann/json.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <utility>
+
+namespace {
+// seconds of fixed overhead, seconds per degree of pan, of tilt and per zoom ratio
+const double kPrior[MotionModel::kDim] = { 0.3, 1.0 / 100, 1.0 / 60, 0.15 };
+const double kPriorWeight = 1.0;
+
+double wrap_pan(double dp)
+{
+    return std::fabs(std::remainder(dp, 360.0));
+}
+}
+
+MotionModel::MotionModel(std::string path)
+    : path_(std::move(path))
+{
+    reset();
+}
+
+void MotionModel::reset()
+{
+    for (int i = 0; i < kDim; ++i) {
+        for (int j = 0; j < kDim; ++j) {
+            ata_[i][j] = (i == j) ? kPriorWeight : 0;
+        }
+        atb_[i] = kPriorWeight * kPrior[i];
+        coef_[i] = kPrior[i];
+    }
+    samples_ = 0;
+    saved_samples_ = 0;
+}
+
+void MotionModel::record(double dp, double dt, double dz, double seconds)
+{
+    if (std::isnan(dp) || std::isnan(dt) || std::isnan(dz) || !(seconds > 0)) {
+        return;
+    }
+
+    const double row[kDim] = { 1.0, wrap_pan(dp), std::fabs(dt), std::fabs(dz) };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < kDim; ++i) {
+        for (int j = 0; j < kDim; ++j) {
+            ata_[i][j] += row[i] * row[j];
+        }
+        atb_[i] += row[i] * seconds;
+    }
+    ++samples_;
+    solve();
+}
+
+double MotionModel::predict(double dp, double dt, double dz)
+{
+    const double row[kDim] = { 1.0, wrap_pan(dp), std::fabs(dt), std::fabs(dz) };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    double seconds = 0;
+    for (int i = 0; i < kDim; ++i) {
+        seconds += coef_[i] * row[i];
+    }
+    return seconds > 0 ? seconds : 0;
+}
+
+size_t MotionModel::samples()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return samples_;
+}
+
+// Gaussian elimination with partial pivoting on the normal equations.
+void MotionModel::solve()
+{
+    double a[kDim][kDim + 1];
+    for (int i = 0; i < kDim; ++i) {
+        for (int j = 0; j < kDim; ++j) {
+            a[i][j] = ata_[i][j];
+        }
+        a[i][kDim] = atb_[i];
+    }
+
+    for (int col = 0; col < kDim; ++col) {
+        int pivot = col;
+        for (int r = col + 1; r < kDim; ++r) {
+            if (std::fabs(a[r][col]) > std::fabs(a[pivot][col])) {
+                pivot = r;
+            }
+        }
+        if (std::fabs(a[pivot][col]) < 1e-12) {
+            return;
+        }
+        std::swap(a[col], a[pivot]);
+
+        for (int r = 0; r < kDim; ++r) {
+            if (r == col) {
+                continue;
+            }
+            double f = a[r][col] / a[col][col];
+            for (int c = col; c <= kDim; ++c) {
+                a[r][c] -= f * a[col][c];
+            }
+        }
+    }
+
+    for (int i = 0; i < kDim; ++i) {
+        coef_[i] = a[i][kDim] / a[i][i];
+    }
+}
+
+bool MotionModel::load()
+{
+    std::ifstream in(path_);
+    if (!in) {
+        return false;
+    }
+
+    try {
+        nlohmann::json j = nlohmann::json::parse(in);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < kDim; ++i) {
+            for (int k = 0; k < kDim; ++k) {
+                ata_[i][k] = j["ata"][i][k];
+            }
+            atb_[i] = j["atb"][i];
+        }
+        samples_ = j["samples"];
+        saved_samples_ = samples_;
+        solve();
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "motion model " << path_ << " parse error " << e.what();
+        std::lock_guard<std::mutex> lock(mutex_);
+        reset();
+        return false;
+    }
+
+    LOG(INFO) << "motion model " << path_ << " loaded, samples:" << samples_;
+    return true;
+}
+
+bool MotionModel::save()
+{
+    nlohmann::json j;
+    size_t samples = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (samples_ == saved_samples_) {
+            return true;
+        }
+        samples = samples_;
+        for (int i = 0; i < kDim; ++i) {
+            for (int k = 0; k < kDim; ++k) {
+                j["ata"][i][k] = ata_[i][k];
+            }
+            j["atb"][i] = atb_[i];
+            j["coef"][i] = coef_[i];
+        }
+        j["samples"] = samples_;
+    }
+
+    // Write aside and rename so a crash never leaves a truncated model behind.
+    const std::string tmp = path_ + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out) {
+            LOG(ERROR) << "motion model " << tmp << " open failed";
+            return false;
+        }
+        out << j.dump(4);
+    }
+    if (std::rename(tmp.c_str(), path_.c_str()) != 0) {
+        LOG(ERROR) << "motion model " << path_ << " rename failed";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    saved_samples_ = samples;
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef MOTION_MODEL_H
+#define MOTION_MODEL_H
+
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Per-camera model of how long a move takes to settle.
+ *
+ * Fits seconds = c0 + c1 * |dp| + c2 * |dt| + c3 * |dz| by least squares over every
+ * observed move, regularized toward typical ball camera speeds so that the first
+ * few samples do not produce nonsense. The accumulated sums are saved to a json
+ * file so a restart does not relearn from scratch.
+ */
+class MotionModel {
+public:
+    static const int kDim = 4;
+
+    explicit MotionModel(std::string path);
+
+    void record(double dp, double dt, double dz, double seconds);
+    double predict(double dp, double dt, double dz);
+    size_t samples();
+
+    bool load();
+    // Writes the model if it has learned anything since it was loaded or last saved.
+    bool save();
+
+private:
+    void reset();
+    void solve();
+
+private:
+    std::string path_;
+
+    std::mutex mutex_;
+    double ata_[kDim][kDim];
+    double atb_[kDim];
+    double coef_[kDim];
+    size_t samples_ = 0;
+    size_t saved_samples_ = 0;
+};
+
+#endif // MOTION_MODEL_H
@@ -45,6 +45,13 @@ void MqttInteractor::set_cmd_callback(MqttCommandCallback cb)
 }
 
 void MqttInteractor::send_status(const BallCameraStatus& status)
+{
+    std::string serialized = status_json(status);
+    mqttActor.sendData(mqtt_pub_topic + status.device_serial, serialized);
+    VLOG(5) << " published the status of " << status.device_serial << ":" << serialized;
+}
+
+std::string MqttInteractor::status_json(const BallCameraStatus& status)
 {
     nlohmann::json j {
         { "device_serial", status.device_serial },
@@ -54,12 +61,43 @@ void MqttInteractor::send_status(const BallCameraStatus& status)
         { "p", status.p },
         { "t", status.t },
         { "z", status.z },
+        { "cmd_sent", status.cmd_sent },
+        { "cmd_coalesced", status.cmd_coalesced },
+        { "health", status.health },
+        { "queue_depth", status.queue_depth },
+        { "queue_conflated", status.queue_conflated },
+        { "queue_stale", status.queue_stale },
+        { "queue_age_ms", status.queue_age_ms },
+        { "ingest_processed", status.ingest_processed },
+        { "ingest_stale", status.ingest_stale },
+        { "ingest_superseded", status.ingest_superseded },
+        { "ingest_future", status.ingest_future },
+        { "ingest_age_p50_ms", status.ingest_age_p50_ms },
+        { "ingest_age_p99_ms", status.ingest_age_p99_ms },
+        { "ingest_age_max_ms", status.ingest_age_max_ms },
         { "ts", afl::Timestamp::now().milliSecondsSinceEpoch() }
     };
 
-    std::string serialized = j.dump();
-    mqttActor.sendData(mqtt_pub_topic + status.device_serial, serialized);
-    VLOG(5) << " published the status of " << status.device_serial << ":" << serialized;
+    for (int s = 0; s < StageLatency::STAGES; ++s) {
+        const auto& summary = status.latency[s];
+        j["latency"][StageLatency::name(static_cast<StageLatency::Stage>(s))] = {
+            { "n", summary.count },
+            { "p50_ms", summary.p50_ms },
+            { "p90_ms", summary.p90_ms },
+            { "p99_ms", summary.p99_ms },
+            { "max_ms", summary.max_ms }
+        };
+    }
+
+    if (status.shard >= 0) {
+        j["shard"] = {
+            { "index", status.shard },
+            { "cameras", status.shard_cameras },
+            { "lag_ms", status.shard_lag_ms }
+        };
+    }
+
+    return j.dump();
 }
 
 void MqttInteractor::send_event(const std::string& ev)
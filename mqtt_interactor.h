@@ -3,6 +3,7 @@
 #include "base/Timestamp.h"
 #include "control_context.h"
 #include "mqtt_actor.h"
+#include "stage_latency.h"
 
 #include <base/SignalSlot.h>
 #include <glog/logging.h>
@@ -31,6 +32,31 @@ struct BallCameraStatus {
     double p;
     double t;
     double z;
+
+    uint64_t cmd_sent;
+    uint64_t cmd_coalesced;
+
+    std::string health;
+
+    size_t queue_depth;
+    uint64_t queue_conflated;
+    uint64_t queue_stale;
+    double queue_age_ms;
+
+    // Process wide, from ZmqInteractor::ingest_stats.
+    uint64_t ingest_processed;
+    uint64_t ingest_stale;
+    uint64_t ingest_superseded;
+    uint64_t ingest_future;
+    int64_t ingest_age_p50_ms;
+    int64_t ingest_age_p99_ms;
+    int64_t ingest_age_max_ms;
+
+    StageLatency::Summary latency[StageLatency::STAGES];
+
+    int shard = -1; // loop shard of the camera, -1 when not sharded
+    size_t shard_cameras = 0;
+    double shard_lag_ms = 0;
 };
 
 using MqttCommandCallback = std::function<void(const ControlCommand&)>;
@@ -44,6 +70,8 @@ public:
     void send_status(const BallCameraStatus& status);
     void send_event(const std::string& ev);
 
+    static std::string status_json(const BallCameraStatus& status);
+
 private:
     std::string mqtt_addr;
     std::string mqtt_pub_topic = "/ptz/status/";
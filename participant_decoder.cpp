@@ -0,0 +1,198 @@
+#include "participant_decoder.h"
+
+#include <glog/logging.h>
+#include <google/protobuf/descriptor.h>
+
+#include <cstring>
+
+namespace {
+
+enum WireType {
+    VARINT = 0,
+    FIXED64 = 1,
+    LENGTH_DELIMITED = 2,
+    FIXED32 = 5,
+};
+
+int field_number(const google::protobuf::Descriptor* descriptor, const char* lowercase_name)
+{
+    const auto* field = descriptor->FindFieldByLowercaseName(lowercase_name);
+    LOG_IF(FATAL, field == nullptr) << descriptor->full_name() << " has no field " << lowercase_name;
+    return field->number();
+}
+
+inline bool read_varint(const uint8_t*& p, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        const uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (0 == (byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool read_fixed(const uint8_t*& p, const uint8_t* end, size_t size, uint64_t& value)
+{
+    if (static_cast<size_t>(end - p) < size) {
+        return false;
+    }
+
+    // The wire format is little endian, like every host this runs on.
+    value = 0;
+    std::memcpy(&value, p, size);
+    p += size;
+    return true;
+}
+
+// Reads any scalar field into bits, telling fixed32 apart so floats can be widened.
+inline bool read_scalar(const uint8_t*& p, const uint8_t* end, uint32_t wire_type, uint64_t& bits)
+{
+    switch (wire_type) {
+    case VARINT:
+        return read_varint(p, end, bits);
+    case FIXED64:
+        return read_fixed(p, end, 8, bits);
+    case FIXED32:
+        return read_fixed(p, end, 4, bits);
+    default:
+        return false;
+    }
+}
+
+inline double as_double(uint32_t wire_type, uint64_t bits)
+{
+    if (FIXED64 == wire_type) {
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+    if (FIXED32 == wire_type) {
+        float f;
+        const uint32_t low = static_cast<uint32_t>(bits);
+        std::memcpy(&f, &low, sizeof(f));
+        return f;
+    }
+    return static_cast<double>(bits);
+}
+
+inline bool skip(const uint8_t*& p, const uint8_t* end, uint32_t wire_type)
+{
+    uint64_t value = 0;
+    if (LENGTH_DELIMITED != wire_type) {
+        return read_scalar(p, end, wire_type, value);
+    }
+
+    if (!read_varint(p, end, value) || value > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    p += value;
+    return true;
+}
+
+} // namespace
+
+ParticipantDecoder::ParticipantDecoder()
+{
+    const auto* infos = v2x::ParticipantInfos::descriptor();
+    participants_ = field_number(infos, "participants");
+
+    const auto* participant = infos->FindFieldByNumber(participants_)->message_type();
+    LOG_IF(FATAL, participant == nullptr) << "ParticipantInfos.participants is not a message";
+    ptcid_ = field_number(participant, "ptcid");
+    latitude_ = field_number(participant, "latitude");
+    longitude_ = field_number(participant, "longitude");
+    speedx_ = field_number(participant, "speedx");
+    speedy_ = field_number(participant, "speedy");
+    plate_ = field_number(participant, "plate");
+    timestamp_ = field_number(participant, "timestamp");
+}
+
+bool ParticipantDecoder::decode(const char* data, size_t size, ParticipantFrame& frame) const
+{
+    frame.clear();
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    while (p < end) {
+        uint64_t tag = 0;
+        if (!read_varint(p, end, tag)) {
+            return false;
+        }
+
+        const uint32_t wire_type = tag & 0x7;
+        if (static_cast<int>(tag >> 3) != participants_ || LENGTH_DELIMITED != wire_type) {
+            if (!skip(p, end, wire_type)) {
+                return false;
+            }
+            continue;
+        }
+
+        uint64_t length = 0;
+        if (!read_varint(p, end, length) || length > static_cast<uint64_t>(end - p)) {
+            return false;
+        }
+        if (!decode_participant(p, p + length, frame)) {
+            return false;
+        }
+        p += length;
+    }
+
+    return true;
+}
+
+bool ParticipantDecoder::decode_participant(const uint8_t* p, const uint8_t* end, ParticipantFrame& frame) const
+{
+    // proto3 defaults for anything absent.
+    double latitude = 0, longitude = 0, speedx = 0, speedy = 0;
+    uint64_t ptcid = 0, timestamp = 0;
+    const char* plate = "";
+    size_t plate_size = 0;
+
+    while (p < end) {
+        uint64_t tag = 0;
+        if (!read_varint(p, end, tag)) {
+            return false;
+        }
+
+        const int field = static_cast<int>(tag >> 3);
+        const uint32_t wire_type = tag & 0x7;
+
+        if (LENGTH_DELIMITED == wire_type) {
+            uint64_t length = 0;
+            if (!read_varint(p, end, length) || length > static_cast<uint64_t>(end - p)) {
+                return false;
+            }
+            if (field == plate_) {
+                plate = reinterpret_cast<const char*>(p);
+                plate_size = length;
+            }
+            p += length;
+            continue;
+        }
+
+        uint64_t bits = 0;
+        if (!read_scalar(p, end, wire_type, bits)) {
+            return false;
+        }
+
+        if (field == latitude_) {
+            latitude = as_double(wire_type, bits);
+        } else if (field == longitude_) {
+            longitude = as_double(wire_type, bits);
+        } else if (field == speedx_) {
+            speedx = as_double(wire_type, bits);
+        } else if (field == speedy_) {
+            speedy = as_double(wire_type, bits);
+        } else if (field == ptcid_) {
+            ptcid = bits;
+        } else if (field == timestamp_) {
+            timestamp = bits;
+        }
+    }
+
+    frame.push(latitude, longitude, speedx, speedy, ptcid, plate, plate_size, timestamp);
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef PARTICIPANT_DECODER_H
+#define PARTICIPANT_DECODER_H
+
+#include "participant_frame.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Decodes a serialized ParticipantInfos straight into a ParticipantFrame.
+ *
+ * Walks the protobuf wire format and reads only what control uses (ptcid,
+ * latitude, longitude, speedx, speedy, plate, timestamp), skipping every other
+ * field without building a message. Field numbers are taken from the generated
+ * descriptors, so the decoder follows the .proto file.
+ */
+class ParticipantDecoder {
+public:
+    ParticipantDecoder();
+
+    // false if the data is malformed; frame is then left partially filled.
+    bool decode(const char* data, size_t size, ParticipantFrame& frame) const;
+
+private:
+    bool decode_participant(const uint8_t* p, const uint8_t* end, ParticipantFrame& frame) const;
+
+private:
+    int participants_;
+    int ptcid_;
+    int latitude_;
+    int longitude_;
+    int speedx_;
+    int speedy_;
+    int plate_;
+    int timestamp_;
+};
+
+#endif // PARTICIPANT_DECODER_H
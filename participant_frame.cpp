@@ -0,0 +1,60 @@
+#include "participant_frame.h"
+#include "geo_projector.h"
+
+#include <algorithm>
+
+void ParticipantFrame::clear()
+{
+    x.clear();
+    y.clear();
+    vx.clear();
+    vy.clear();
+    ptcid.clear();
+    plate_key.clear();
+    plates.clear();
+    timestamp.clear();
+    newest = 0;
+    received = 0;
+}
+
+void ParticipantFrame::push(double latitude, double longitude, double speedx, double speedy, uint64_t id,
+    const char* plate, size_t plate_size, uint64_t ts)
+{
+    thread_local UtmProjector projector(utm_zone());
+    double px = 0, py = 0;
+    projector.forward(latitude, longitude, px, py);
+
+    x.push_back(px);
+    y.push_back(py);
+    vx.push_back(speedx);
+    vy.push_back(speedy);
+    ptcid.push_back(id);
+    plate_key.push_back(make_plate_key(plate, plate_size));
+    plates.emplace_back(plate, plate_size);
+    timestamp.push_back(ts);
+    newest = std::max(newest, ts);
+}
+
+void ParticipantFrame::assign(const v2x::ParticipantInfos& participantInfos)
+{
+    clear();
+    for (const auto& ptc : participantInfos.participants()) {
+        push(ptc.latitude(), ptc.longitude(), ptc.speedx(), ptc.speedy(), ptc.ptcid(),
+            ptc.plate().data(), ptc.plate().size(), ptc.timestamp());
+    }
+}
+
+// FNV-1a, never 0 for a non-empty plate.
+uint64_t ParticipantFrame::make_plate_key(const char* plate, size_t size)
+{
+    if (0 == size) {
+        return 0;
+    }
+
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= static_cast<unsigned char>(plate[i]);
+        h *= 1099511628211ULL;
+    }
+    return h == 0 ? 1 : h;
+}
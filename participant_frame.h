@@ -0,0 +1,66 @@
+#ifndef PARTICIPANT_FRAME_H
+#define PARTICIPANT_FRAME_H
+
+#include <ihspb/pub-sub.pb.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One ParticipantInfos frame projected to UTM, in structure-of-arrays form.
+ *
+ * Filled once per frame by ZmqInteractor and read by every ControlContext, so each
+ * participant is projected once no matter how many cameras are configured. The
+ * vectors keep their capacity between frames, and plates are short enough to stay
+ * in the strings' inline buffers.
+ */
+struct ParticipantFrame {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> vx;
+    std::vector<double> vy;
+    std::vector<uint64_t> ptcid;
+    std::vector<uint64_t> plate_key; // 0 if the participant has no plate
+    std::vector<std::string> plates;
+    std::vector<uint64_t> timestamp;
+    uint64_t newest = 0; // largest participant timestamp, in milliseconds
+    int64_t received = 0; // when the message arrived, VirtualClock, in microseconds
+
+    size_t size() const
+    {
+        return x.size();
+    }
+
+    const std::string& plate(size_t i) const
+    {
+        return plates[i];
+    }
+
+    void clear();
+    // Projects (latitude, longitude) to UTM and appends one participant.
+    void push(double latitude, double longitude, double speedx, double speedy, uint64_t id,
+        const char* plate, size_t plate_size, uint64_t ts);
+
+    void assign(const v2x::ParticipantInfos& participantInfos);
+
+    static uint64_t make_plate_key(const char* plate, size_t size);
+    static uint64_t make_plate_key(const std::string& plate)
+    {
+        return make_plate_key(plate.data(), plate.size());
+    }
+};
+
+/**
+ * @brief A received frame's projection, plus the message it is parsed into when
+ * the selective decoder cannot be used.
+ *
+ * Shared read-only with the control loops once published; ZmqInteractor recycles
+ * it when no loop holds it any more.
+ */
+struct ParticipantBatch {
+    v2x::ParticipantInfos infos;
+    ParticipantFrame frame;
+};
+
+#endif // PARTICIPANT_FRAME_H
@@ -1,5 +1,5 @@
 #include "pid_method.h"
-#include "base/Timestamp.h"
+#include "virtual_clock.h"
 
 PidMethod::PidMethod(const PidConfig& config)
     : config_(config)
@@ -8,7 +8,7 @@ PidMethod::PidMethod(const PidConfig& config)
 
 double PidMethod::calc(double err)
 {
-    int64_t now = afl::Timestamp::now().microSecondsSinceEpoch();
+    int64_t now = VirtualClock::now().microSecondsSinceEpoch();
     double diff_time = (now - last_time_) * 1e-6;
 
     auto retv = (last_time_ > 0) ? (config_.P * err + config_.I * (err_acc_ += err) + config_.D * (err - last_err_) / diff_time) : 0;
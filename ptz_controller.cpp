@@ -1,9 +1,13 @@
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include "ptz_controller.h"
+#include "geometry_kernel.h"
 #include "glog/logging.h"
 #include "httplib.h"
+#include "read_config.h"
+#include "virtual_clock.h"
 #include "yushi_ball_camera.h"
 
+#include <algorithm>
 #include <gflags/gflags.h>
 #include <iostream>
 #include <math.h>
@@ -11,17 +15,36 @@ DEFINE_double(zoom, NAN, "");
 DEFINE_double(dp, NAN, "");
 DEFINE_double(dt, NAN, "");
 DEFINE_double(dz, 0, "");
+DEFINE_double(ptz_cache_age, 2.0, "Max age in seconds of the cached ptz before the camera is queried again");
+DEFINE_double(settle_timeout, 3.0, "Max seconds to wait for the camera to settle after a preset move");
+DEFINE_int32(settle_poll_min_ms, 100, "Poll interval while the camera is close to settled");
+DEFINE_int32(settle_poll_max_ms, 400, "Poll interval while the camera is still moving fast");
+DEFINE_double(velocity_kp, 0.5, "Velocity tracking: degree/s added per degree of pointing error");
+DEFINE_double(velocity_deadband, 1.0, "Velocity tracking: rate change in degree/s below which no command is sent");
+DEFINE_double(velocity_refresh, 2.0, "Velocity tracking: seconds of dead reckoning before the position is measured again");
+DEFINE_string(motion_model_dir, "", "Where the learned motion models are kept, default <workroot>/etc");
+DEFINE_bool(motion_observe_tracking, true, "Also learn the motion model from tracking moves, polling only while nothing else waits for the camera");
+
+static std::string motion_model_path(const BallCameraConfig& config)
+{
+    const std::string dir = FLAGS_motion_model_dir.empty() ? misc::getWorkrootPath() + "/etc" : FLAGS_motion_model_dir;
+    return dir + "/motion_" + config.device_serial + ".json";
+}
 
 PtzController::PtzController(const BallCameraConfig& ballCameraConfig, const PidConfig& pidConfig)
     : camera_(get_ball_camera(ballCameraConfig.brand,
         ballCameraConfig.addr,
         ballCameraConfig.preset))
+    , mailbox_(camera_)
     , config_(ballCameraConfig)
+    , motion_(motion_model_path(ballCameraConfig))
 {
     PidMethod cfg(pidConfig);
     pid_p_ = cfg;
     pid_t_ = cfg;
     pid_z_ = cfg;
+
+    motion_.load();
 }
 
 void PtzController::on_vehicle_detected_adjust_zoom(double x, double y, double z,
@@ -32,38 +55,166 @@ void PtzController::on_vehicle_detected_adjust_zoom(double x, double y, double z
     dist = std::copysign(dist, sign);
     z += dist * tan(config_.slope / 180 * M_PI);
 
-    double abs_p = 0, abs_t = 0, abs_z = 1;
-    camera_->get_ptz(abs_p, abs_t, abs_z);
-
-    double needed_p = abs_p, needed_t = abs_t, needed_z = abs_z;
-    get_needed_corrected_ptz(x, y, z, needed_p, needed_t, needed_z, dist);
-
-    camera_->set_ptz(NAN, NAN, needed_z);
+    const auto matched = afl::Timestamp::now();
+    mailbox_.post(PtzMailbox::ZOOM, [=]() {
+        double abs_p = 0, abs_t = 0, abs_z = 1;
+        read_ptz(abs_p, abs_t, abs_z, FLAGS_ptz_cache_age);
+
+        double needed_p = abs_p, needed_t = abs_t, needed_z = abs_z;
+        get_needed_corrected_ptz(x, y, z, needed_p, needed_t, needed_z, dist);
+
+        double p0 = NAN, t0 = NAN, z0 = NAN;
+        rest_ptz(p0, t0, z0);
+        bool ok = issue(matched, [&]() { return write_ptz(NAN, NAN, needed_z); });
+        if (ok) {
+            observe_move(p0, t0, z0, NAN, NAN, needed_z);
+        }
+        return ok;
+    });
 }
 
 void PtzController::on_vehicle_detected(double x, double y, double z,
     double vx, double vy)
 {
-    double err_p = 0.0;
-    double err_t = 0.0;
-    double err_z = 0.0;
+    auto dist = std::hypot(x - config_.x, y - config_.y);
+    auto sign = (x - config_.x) * vx + (y - config_.y) * vy;
+    dist = std::copysign(dist, sign);
+    z += dist * tan(config_.slope / 180 * M_PI);
 
+    // The PID state is only touched on the camera's executor.
+    const auto matched = afl::Timestamp::now();
+    mailbox_.post(PtzMailbox::PAN_TILT, [=]() {
+        double abs_p = 0, abs_t = 0, abs_z = 1;
+        read_ptz(abs_p, abs_t, abs_z, FLAGS_ptz_cache_age);
+
+        double needed_p = abs_p, needed_t = abs_t, needed_z = abs_z;
+        get_needed_corrected_ptz(x, y, z, needed_p, needed_t, needed_z, dist);
+
+        double err_p = needed_p - abs_p;
+        double err_t = needed_t - abs_t;
+        double err_z = needed_z - abs_z;
+        // camera_->set_ptz(abs_p + pid_p_.calc(err_p), abs_t + pid_t_.calc(err_t), 1);
+        const double p = abs_p + pid_p_.calc(err_p);
+        const double t = abs_t + pid_t_.calc(err_t);
+        const double z = abs_z + pid_z_.calc(err_z);
+
+        double p0 = NAN, t0 = NAN, z0 = NAN;
+        rest_ptz(p0, t0, z0);
+        bool ok = issue(matched, [&]() { return write_ptz(p, t, z); });
+        if (ok) {
+            observe_move(p0, t0, z0, p, t, z);
+        }
+        return ok;
+    });
+}
+
+/**
+ * @brief Follow the target with a continuous move.
+ *
+ * The pan/tilt rate is the angular speed of the target as seen from the camera,
+ * plus a proportional correction of the pointing error. A new command is only
+ * sent when the rate changes by more than the deadband.
+ */
+void PtzController::on_vehicle_tracked(double x, double y, double z, double vx, double vy)
+{
     auto dist = std::hypot(x - config_.x, y - config_.y);
     auto sign = (x - config_.x) * vx + (y - config_.y) * vy;
     dist = std::copysign(dist, sign);
     z += dist * tan(config_.slope / 180 * M_PI);
 
-    double abs_p = 0, abs_t = 0, abs_z = 1;
-    camera_->get_ptz(abs_p, abs_t, abs_z);
+    last_tracked_ = VirtualClock::now();
+    const auto matched = afl::Timestamp::now();
+    mailbox_.post(PtzMailbox::PAN_TILT, [=]() {
+        double cur_p = NAN, cur_t = NAN;
+        if (!estimate_pt(cur_p, cur_t)) {
+            return false;
+        }
+
+        // Where the target is now and where it will be in one second.
+        double p0 = cur_p, t0 = cur_t, z0 = 1;
+        double p1 = cur_p, t1 = cur_t, z1 = 1;
+        get_needed_corrected_ptz(x, y, z, p0, t0, z0, dist);
+        get_needed_corrected_ptz(x + vx, y + vy, z, p1, t1, z1, dist);
+
+        double rate_p = remainder(p1 - p0, 360.0) + FLAGS_velocity_kp * remainder(p0 - cur_p, 360.0);
+        double rate_t = (t1 - t0) + FLAGS_velocity_kp * (t0 - cur_t);
+        // Dead reckon with what the camera will really do, e.g. rates below its slowest step stop it.
+        camera_->actual_speed(rate_p, rate_t);
+
+        if (fabs(rate_p - velocity_.vp) < FLAGS_velocity_deadband && fabs(rate_t - velocity_.vt) < FLAGS_velocity_deadband) {
+            return true;
+        }
+
+        bool ok = issue(matched, [&]() { return camera_->continuous_move(rate_p, rate_t); });
+        // The camera is slewing, any cached pan/tilt is stale from here on.
+        cache_.invalidate_pan_tilt();
+        at_rest_ = false;
+        velocity_.p = cur_p;
+        velocity_.t = cur_t;
+        velocity_.time = VirtualClock::now();
+        velocity_.vp = ok ? rate_p : 0;
+        velocity_.vt = ok ? rate_t : 0;
+        return ok;
+    });
+}
 
-    double needed_p = abs_p, needed_t = abs_t, needed_z = abs_z;
-    get_needed_corrected_ptz(x, y, z, needed_p, needed_t, needed_z, dist);
+void PtzController::stop_tracking()
+{
+    last_tracked_ = afl::Timestamp();
+    mailbox_.post(PtzMailbox::PAN_TILT, [this]() {
+        bool ok = camera_->continuous_move(0, 0);
+        velocity_ = VelocityState();
+        cache_.invalidate();
+        at_rest_ = false;
+        return ok;
+    });
+}
+
+void PtzController::stop_if_stalled()
+{
+    if (!last_tracked_.valid() || afl::timeDifference(VirtualClock::now(), last_tracked_) < FLAGS_velocity_refresh) {
+        return;
+    }
+
+    // Fires once per stall; the next tracked frame re-arms it.
+    last_tracked_ = afl::Timestamp();
+    mailbox_.post(PtzMailbox::PAN_TILT, [this]() {
+        if (0 == velocity_.vp && 0 == velocity_.vt) {
+            return true;
+        }
+
+        LOG(WARNING) << config_.name << " no tracked frame in " << FLAGS_velocity_refresh << "s, stop the continuous move";
+        bool ok = camera_->continuous_move(0, 0);
+        velocity_ = VelocityState();
+        cache_.invalidate_pan_tilt();
+        return ok;
+    });
+}
+
+/**
+ * @brief Current pan/tilt under a continuous move: the last measurement plus the
+ *        commanded rate since then, measured again every velocity_refresh seconds.
+ */
+bool PtzController::estimate_pt(double& P, double& T)
+{
+    auto now = VirtualClock::now();
+    if (velocity_.time.valid()) {
+        double elapsed = afl::timeDifference(now, velocity_.time);
+        if (elapsed < FLAGS_velocity_refresh) {
+            P = fmod(velocity_.p + velocity_.vp * elapsed + 360.0, 360.0);
+            T = velocity_.t + velocity_.vt * elapsed;
+            return true;
+        }
+    }
 
-    err_p = needed_p - abs_p;
-    err_t = needed_t - abs_t;
-    err_z = needed_z - abs_z;
-    // camera_->set_ptz(abs_p + pid_p_.calc(err_p), abs_t + pid_t_.calc(err_t), 1);
-    camera_->set_ptz(abs_p + pid_p_.calc(err_p), abs_t + pid_t_.calc(err_t), abs_z + pid_z_.calc(err_z));
+    double Z = NAN;
+    if (!camera_->get_ptz(P, T, Z)) {
+        return false;
+    }
+    velocity_.p = P;
+    velocity_.t = T;
+    velocity_.time = now;
+    return true;
 }
 
 const BallCameraConfig& PtzController::get_config()
@@ -71,33 +222,323 @@ const BallCameraConfig& PtzController::get_config()
     return config_;
 }
 
-void PtzController::reset_camera(const uint64_t& preset_id)
+void PtzController::reset_camera(const uint64_t& preset_id, DoneCallback on_settled)
 {
-    camera_->go_to_preset(preset_id);
-    usleep(1000 * 1000);
+    // Commands queued after this one wait on the executor until the camera has settled.
+    camera_->submit([=]() {
+        double p0 = NAN, t0 = NAN, z0 = NAN, age = 0;
+        rest_ptz(p0, t0, z0);
+        cache_.invalidate();
+        at_rest_ = false;
+        // A preset move ends any continuous move.
+        velocity_ = VelocityState();
+
+        // Preset positions are learned on first arrival, after that the move time can be predicted.
+        double expected = NAN;
+        PresetPtz target { NAN, NAN, NAN };
+        auto iter = preset_ptz_.find(preset_id);
+        if (iter != preset_ptz_.end()) {
+            target = iter->second;
+            expected = predict_motion_time(p0, t0, z0, target.p, target.t, target.z);
+        }
+
+        bool ok = camera_->go_to_preset(preset_id) && settle_from(p0, t0, z0, target.p, target.t, target.z, expected, false);
+        if (ok) {
+            auto& pos = preset_ptz_[preset_id];
+            cache_.get(pos.p, pos.t, pos.z, age);
+        }
+        if (on_settled) {
+            on_settled(ok);
+        }
+        return ok;
+    });
 }
 
 void PtzController::reset_camera_immediately(const uint64_t& preset_id)
 {
-    camera_->go_to_preset(preset_id);
+    camera_->async_go_to_preset(preset_id, [this](bool) {
+        cache_.invalidate();
+        at_rest_ = false;
+    });
 }
 
 void PtzController::reset_camera(double p, double t, double z)
 {
-    camera_->set_ptz(p, t, z);
-    pid_p_.reset();
-    pid_t_.reset();
-    pid_z_.reset();
+    camera_->submit([=]() {
+        double p0 = NAN, t0 = NAN, z0 = NAN;
+        rest_ptz(p0, t0, z0);
+
+        bool ok = write_ptz(p, t, z) && settle_from(p0, t0, z0, p, t, z, predict_motion_time(p0, t0, z0, p, t, z), false);
+        pid_p_.reset();
+        pid_t_.reset();
+        pid_z_.reset();
+        return ok;
+    });
 }
 
-bool PtzController::snapshot(std::string& pic)
+void PtzController::snapshot(SnapshotCallback cb)
 {
-    return camera_->snapshot(pic);
+    camera_->async_snapshot(std::move(cb));
 }
 
 void PtzController::get_current_ptz(double& P, double& T, double& Z)
 {
-    camera_->get_ptz(P, T, Z);
+    read_ptz(P, T, Z, 0);
+}
+
+void PtzController::get_current_ptz(PtzCallback cb)
+{
+    camera_->submit([this, cb]() {
+        double p = NAN, t = NAN, z = NAN;
+        bool ok = read_ptz(p, t, z, FLAGS_ptz_cache_age);
+        cb(ok, p, t, z);
+        return ok;
+    });
+}
+
+bool PtzController::cached_ptz(double& P, double& T, double& Z, double& age)
+{
+    return cache_.get(P, T, Z, age);
+}
+
+/**
+ * @brief Read the PTZ from the cache, query the camera only if the cache is older than max_age.
+ */
+bool PtzController::read_ptz(double& P, double& T, double& Z, double max_age)
+{
+    double age = 0;
+    if (max_age > 0 && cache_.get(P, T, Z, age) && age <= max_age) {
+        VLOG(3) << config_.name << " use cached ptz, age:" << age;
+        return true;
+    }
+
+    if (!camera_->get_ptz(P, T, Z)) {
+        return false;
+    }
+    cache_.update(P, T, Z);
+    return true;
+}
+
+/**
+ * @brief How long the camera needs to reach (P, T, Z) from where it is now, in seconds.
+ *
+ * @return NAN if the current position is not known
+ */
+double PtzController::predict_motion_time(double P, double T, double Z)
+{
+    double p0 = NAN, t0 = NAN, z0 = NAN, age = 0;
+    if (!cache_.get(p0, t0, z0, age)) {
+        return NAN;
+    }
+    return predict_motion_time(p0, t0, z0, P, T, Z);
+}
+
+double PtzController::predict_motion_time(double p0, double t0, double z0, double P, double T, double Z)
+{
+    if (std::isnan(p0) || std::isnan(t0) || std::isnan(z0)) {
+        return NAN;
+    }
+    return motion_.predict(std::isnan(P) ? 0 : P - p0, std::isnan(T) ? 0 : T - t0, std::isnan(Z) ? 0 : Z - z0);
+}
+
+/**
+ * @brief Whether (p, t, z) is within tolerance of (P, T, Z) in every component both know.
+ */
+static bool near_ptz(double p, double t, double z, double P, double T, double Z)
+{
+    return !(fabs(remainder(p - P, 360.0)) > 0.5) && !(fabs(t - T) > 0.5) && !(fabs(z - Z) > 0.1);
+}
+
+/**
+ * @brief Where the camera was last seen at rest, NaN if it has been moved since.
+ */
+void PtzController::rest_ptz(double& P, double& T, double& Z)
+{
+    double age = 0;
+    if (!at_rest_ || !cache_.get(P, T, Z, age)) {
+        P = T = Z = NAN;
+    }
+}
+
+/**
+ * @brief Learn from a tracking move without holding up the camera.
+ *
+ * Only moves from a known rest position that are large enough to tell apart are polled,
+ * and polling stops as soon as anything else is queued for the camera.
+ */
+void PtzController::observe_move(double p0, double t0, double z0, double P, double T, double Z)
+{
+    if (!FLAGS_motion_observe_tracking || std::isnan(p0) || near_ptz(p0, t0, z0, P, T, Z) || camera_->queued() > 0) {
+        return;
+    }
+    settle_from(p0, t0, z0, P, T, Z, predict_motion_time(p0, t0, z0, P, T, Z), true);
+}
+
+/**
+ * @brief Wait for the move just issued from (p0, t0, z0) toward (P, T, Z) to settle and learn its duration.
+ *
+ * The duration runs to the first poll that saw the final position. A move is only learned
+ * if it started at rest, p0 is NaN otherwise.
+ */
+bool PtzController::settle_from(double p0, double t0, double z0, double P, double T, double Z, double expected, bool yield)
+{
+    const auto start = afl::Timestamp::now();
+    afl::Timestamp arrived;
+    if (!wait_settled(p0, t0, z0, P, T, Z, expected, yield, arrived)) {
+        return false;
+    }
+    at_rest_ = true;
+
+    double p = NAN, t = NAN, z = NAN, age = 0;
+    if (arrived.valid() && cache_.get(p, t, z, age) && !std::isnan(p0) && !near_ptz(p, t, z, p0, t0, z0)) {
+        motion_.record(p - p0, t - t0, z - z0, afl::timeDifference(arrived, start));
+    }
+    return true;
+}
+
+/**
+ * @brief Poll the camera until two consecutive positions agree.
+ *
+ * Polling starts shortly before the expected arrival if it is known, and the wait is
+ * stretched for moves expected to take longer than the settle timeout. The poll interval
+ * grows while the camera is still moving fast and shrinks as it closes in, so arrival
+ * is noticed quickly without flooding the camera.
+ *
+ * Right after the command the camera may not have started yet, so agreeing polls only
+ * count as arrival once the position has left (p0, t0, z0), reached (P, T, Z), or has
+ * been seen moving. NaN marks an unknown start or target component. A camera that stays
+ * still for the whole timeout is taken to have been there already, arrived stays invalid.
+ *
+ * @param yield give up as soon as another task is queued for the camera
+ * @param arrived time of the first poll that saw the final position
+ */
+bool PtzController::wait_settled(double p0, double t0, double z0, double P, double T, double Z, double expected, bool yield,
+    afl::Timestamp& arrived)
+{
+    const auto start = afl::Timestamp::now();
+    const double timeout = expected > 0 ? std::max(FLAGS_settle_timeout, expected * 1.5) : FLAGS_settle_timeout;
+    const bool start_known = !std::isnan(p0) && !std::isnan(t0) && !std::isnan(z0);
+    const bool target_known = !std::isnan(P) || !std::isnan(T) || !std::isnan(Z);
+    double last_p = NAN, last_t = NAN, last_z = NAN;
+    afl::Timestamp first_seen;
+    bool moved = false;
+    bool still = false;
+    int interval_ms = FLAGS_settle_poll_min_ms;
+
+    // Sleeps in short steps while yielding, so queued work is not held up.
+    auto pause = [&](int64_t us) {
+        while (us > 0 && !(yield && camera_->queued() > 0)) {
+            const int64_t step = yield ? std::min<int64_t>(us, 10 * 1000) : us;
+            usleep(static_cast<useconds_t>(step));
+            us -= step;
+        }
+        return !(yield && camera_->queued() > 0);
+    };
+
+    if (expected > 0 && !pause(static_cast<int64_t>(std::min(expected * 0.8, FLAGS_settle_timeout) * 1e6))) {
+        return false;
+    }
+
+    while (afl::timeDifference(afl::Timestamp::now(), start) < timeout) {
+        if (!pause(interval_ms * 1000)) {
+            VLOG(2) << config_.name << " camera busy, stop polling";
+            return false;
+        }
+
+        double p = NAN, t = NAN, z = NAN;
+        if (!camera_->get_ptz(p, t, z)) {
+            continue;
+        }
+        const auto polled = afl::Timestamp::now();
+
+        double dp = fabs(remainder(p - last_p, 360.0));
+        double dt = fabs(t - last_t);
+        double dz = fabs(z - last_z);
+        moved = moved || (start_known && !near_ptz(p, t, z, p0, t0, z0)) || (target_known && near_ptz(p, t, z, P, T, Z));
+        still = dp < 0.1 && dt < 0.1 && dz < 0.05;
+        if (!still) {
+            first_seen = polled;
+        }
+        if (still && moved) {
+            cache_.update(p, t, z);
+            arrived = first_seen;
+            VLOG(1) << config_.name << " settled after " << afl::timeDifference(arrived, start) << "s";
+            return true;
+        }
+
+        bool moving_fast = std::isnan(dp) || dp > 5 || dt > 5;
+        moved = moved || (!std::isnan(dp) && !still);
+        interval_ms = moving_fast ? std::min(interval_ms * 2, FLAGS_settle_poll_max_ms) : FLAGS_settle_poll_min_ms;
+        last_p = p;
+        last_t = t;
+        last_z = z;
+    }
+
+    if (still) {
+        cache_.update(last_p, last_t, last_z);
+        VLOG(1) << config_.name << " did not move in " << timeout << "s, already in place";
+        return true;
+    }
+
+    LOG(WARNING) << config_.name << " not settled in " << timeout << "s";
+    return false;
+}
+
+bool PtzController::write_ptz(double P, double T, double Z)
+{
+    at_rest_ = false;
+    if (!camera_->set_ptz(P, T, Z)) {
+        cache_.invalidate();
+        return false;
+    }
+    cache_.update(P, T, Z);
+    return true;
+}
+
+/**
+ * @brief Sends one tracking command, recording how long it waited since the match
+ * and how long the camera took to acknowledge it.
+ */
+bool PtzController::issue(afl::Timestamp matched, const std::function<bool()>& command)
+{
+    const auto issued = afl::Timestamp::now();
+    latency_.record(StageLatency::MATCH_TO_ISSUE, issued.microSecondsSinceEpoch() - matched.microSecondsSinceEpoch());
+
+    bool ok = command();
+    if (ok) {
+        latency_.record(StageLatency::ISSUE_TO_ACK, afl::Timestamp::now().microSecondsSinceEpoch() - issued.microSecondsSinceEpoch());
+    }
+    return ok;
+}
+
+void PtzController::save_motion_model()
+{
+    motion_.save();
+}
+
+StageLatency& PtzController::latency()
+{
+    return latency_;
+}
+
+void PtzController::wait_idle()
+{
+    camera_->submit([]() { return true; }).wait();
+}
+
+uint64_t PtzController::commands_sent() const
+{
+    return mailbox_.sent();
+}
+
+uint64_t PtzController::commands_coalesced() const
+{
+    return mailbox_.coalesced();
+}
+
+std::string PtzController::health()
+{
+    return camera_->health();
 }
 
 /**
@@ -165,22 +606,6 @@ void PtzController::adjust_by_bias(double& degree2north)
  */
 void PtzController::get_needed_ptz(double x, double y, double z, double& P, double& T, double& Z)
 {
-    const double pi = 3.141592654; // 2 * acos(0);
-
-    double delta_x = x - config_.x;
-    double delta_y = y - config_.y;
-    double delta_h = config_.z - z;
-
-    double dis_2 = sqrt(delta_x * delta_x + delta_y * delta_y);
-    double dis_3 = sqrt(delta_x * delta_x + delta_y * delta_y + delta_h * delta_h);
-
-    if (dis_2 < 1e-6 || dis_3 < 1e-6)
-        return;
-
-    // Use theta to compute the value of P. Theta's range is [-90°, 90°].
-    double theta = asin(delta_y / dis_2) * 180 / pi;
-    double phi = asin(delta_h / dis_3) * 180 / pi;
-
-    P = delta_x > 0 ? (90 - theta) : 360 - (90 - theta);
-    T = phi;
+    // Same evaluation as the batch kernel, so single targets and whole frames agree.
+    geometry::pan_tilt(x - config_.x, y - config_.y, config_.z - z, P, T);
 }
\ No newline at end of file
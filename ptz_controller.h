@@ -2,11 +2,16 @@
 #define PTZ_CONTROLLER_H
 
 #include "ball_camera.h"
+#include "motion_model.h"
 #include "pid_method.h"
+#include "ptz_mailbox.h"
+#include "ptz_state_cache.h"
+#include "stage_latency.h"
 
 #include <utils/singleton.h>
 
 #include <memory>
+#include <unordered_map>
 
 class PtzController {
 public:
@@ -14,32 +19,89 @@ public:
 
     void on_vehicle_detected_adjust_zoom(double x, double y, double z, double vx, double vy);
     void on_vehicle_detected(double x, double y, double z, double vx, double vy);
+    // Velocity tracking: follow the target with pan/tilt rates instead of absolute jumps.
+    void on_vehicle_tracked(double x, double y, double z, double vx, double vy);
+    void stop_tracking();
+    // Dead-man for velocity tracking: stops the continuous move once on_vehicle_tracked
+    // has not been called for velocity_refresh seconds. Call periodically from the
+    // thread that calls on_vehicle_tracked.
+    void stop_if_stalled();
 
     const BallCameraConfig& get_config();
 
-    void reset_camera(const uint64_t& preset);
+    // Returns at once, on_settled runs on the camera's executor when the camera has arrived.
+    void reset_camera(const uint64_t& preset, DoneCallback on_settled = nullptr);
 
     void reset_camera_immediately(const uint64_t& preset);
 
     void reset_camera(double p, double t, double z);
 
-    bool snapshot(std::string& pic);
+    void snapshot(SnapshotCallback cb);
 
     void get_current_ptz(double& P, double& T, double& Z);
+    void get_current_ptz(PtzCallback cb);
+    bool cached_ptz(double& P, double& T, double& Z, double& age);
+
+    // Block until every command submitted so far has been handled by the camera.
+    void wait_idle();
+
+    double predict_motion_time(double P, double T, double Z);
+    // Write the learned motion model if it changed, kept off the per-move path.
+    void save_motion_model();
+
+    // Per stage latencies of this camera's tracking, from sensor timestamp to camera ack.
+    StageLatency& latency();
+
+    uint64_t commands_sent() const;
+    uint64_t commands_coalesced() const;
+    std::string health();
+    void get_needed_ptz(double x, double y, double z, double& P, double& T, double& Z);
     void get_needed_corrected_ptz(double x, double y, double z, double& P, double& T, double& Z, double dist);
 
     void calibrate(double x, double y, double& dp, double& dt);
 
 private:
     void adjust_by_bias(double& degree_by_zero);
-    void get_needed_ptz(double x, double y, double z, double& P, double& T, double& Z);
+    bool read_ptz(double& P, double& T, double& Z, double max_age);
+    bool write_ptz(double P, double T, double Z);
+    bool issue(afl::Timestamp matched, const std::function<bool()>& command);
+    double predict_motion_time(double p0, double t0, double z0, double P, double T, double Z);
+    void rest_ptz(double& P, double& T, double& Z);
+    void observe_move(double p0, double t0, double z0, double P, double T, double Z);
+    bool settle_from(double p0, double t0, double z0, double P, double T, double Z, double expected, bool yield);
+    bool wait_settled(double p0, double t0, double z0, double P, double T, double Z, double expected, bool yield,
+        afl::Timestamp& arrived);
+    bool estimate_pt(double& P, double& T);
 
 private:
     std::shared_ptr<BallCamera> camera_;
+    PtzMailbox mailbox_;
+    PtzStateCache cache_;
     PidMethod pid_p_;
     PidMethod pid_t_;
     PidMethod pid_z_;
     BallCameraConfig config_;
+    MotionModel motion_;
+    StageLatency latency_;
+    bool at_rest_ = false; // cache_ holds where the camera was last seen at rest, only touched on the executor
+
+    struct PresetPtz {
+        double p;
+        double t;
+        double z;
+    };
+    std::unordered_map<uint64_t, PresetPtz> preset_ptz_; // only touched on the camera's executor
+
+    // Dead reckoning of pan/tilt under a continuous move, only touched on the camera's executor.
+    struct VelocityState {
+        double p = NAN;
+        double t = NAN;
+        afl::Timestamp time;
+        double vp = 0;
+        double vt = 0;
+    };
+    VelocityState velocity_;
+    afl::Timestamp last_tracked_; // only touched by the caller of on_vehicle_tracked
 };
 
 #endif // PTZ_CONTROLLER_H
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "ptz_mailbox.h"
+
+PtzMailbox::PtzMailbox(std::shared_ptr<BallCamera> camera)
+    : camera_(std::move(camera))
+{
+}
+
+void PtzMailbox::post(Slot slot, std::function<bool()> cmd)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool queued = static_cast<bool>(pending_[slot]);
+        pending_[slot] = std::move(cmd);
+        if (queued) {
+            ++coalesced_;
+            return;
+        }
+    }
+
+    camera_->submit([this, slot]() { return drain(slot); });
+}
+
+bool PtzMailbox::drain(Slot slot)
+{
+    std::function<bool()> cmd;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cmd.swap(pending_[slot]);
+    }
+
+    if (!cmd) {
+        return false;
+    }
+
+    ++sent_;
+    return cmd();
+}
+
+uint64_t PtzMailbox::sent() const
+{
+    return sent_;
+}
+
+uint64_t PtzMailbox::coalesced() const
+{
+    return coalesced_;
+}
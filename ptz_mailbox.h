@@ -0,0 +1,45 @@
+#ifndef PTZ_MAILBOX_H
+#define PTZ_MAILBOX_H
+
+#include "ball_camera.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Latest-wins slots in front of a camera's executor.
+ *
+ * A command posted to a slot that still holds an unsent command replaces it,
+ * so the camera always moves to the newest target instead of chasing old ones.
+ */
+class PtzMailbox {
+public:
+    enum Slot {
+        PAN_TILT = 0,
+        ZOOM,
+        SLOT_NUM
+    };
+
+    explicit PtzMailbox(std::shared_ptr<BallCamera> camera);
+
+    void post(Slot slot, std::function<bool()> cmd);
+
+    uint64_t sent() const;
+    uint64_t coalesced() const;
+
+private:
+    bool drain(Slot slot);
+
+private:
+    std::shared_ptr<BallCamera> camera_;
+
+    std::mutex mutex_;
+    std::function<bool()> pending_[SLOT_NUM];
+
+    std::atomic<uint64_t> sent_ { 0 };
+    std::atomic<uint64_t> coalesced_ { 0 };
+};
+
+#endif // PTZ_MAILBOX_H
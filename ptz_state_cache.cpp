@@ -0,0 +1,49 @@
+#include "ptz_state_cache.h"
+#include "virtual_clock.h"
+
+#include <algorithm>
+
+bool PtzStateCache::get(double& p, double& t, double& z, double& age)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (std::isnan(p_) || std::isnan(t_) || std::isnan(z_)) {
+        return false;
+    }
+
+    p = p_;
+    t = t_;
+    z = z_;
+    const auto now = VirtualClock::now();
+    age = std::max({ afl::timeDifference(now, p_time_), afl::timeDifference(now, t_time_), afl::timeDifference(now, z_time_) });
+    return true;
+}
+
+void PtzStateCache::update(double p, double t, double z)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = VirtualClock::now();
+    if (!std::isnan(p)) {
+        p_ = p;
+        p_time_ = now;
+    }
+    if (!std::isnan(t)) {
+        t_ = t;
+        t_time_ = now;
+    }
+    if (!std::isnan(z)) {
+        z_ = z;
+        z_time_ = now;
+    }
+}
+
+void PtzStateCache::invalidate()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    p_ = t_ = z_ = NAN;
+}
+
+void PtzStateCache::invalidate_pan_tilt()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    p_ = t_ = NAN;
+}
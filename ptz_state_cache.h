@@ -0,0 +1,41 @@
+#ifndef PTZ_STATE_CACHE_H
+#define PTZ_STATE_CACHE_H
+
+#include "base/Timestamp.h"
+
+#include <cmath>
+#include <mutex>
+
+/**
+ * @brief Last known PTZ of a camera, from acknowledged moves and live queries.
+ *
+ * Each component carries its own timestamp, so a zoom-only write does not make an
+ * old pan/tilt look fresh.
+ */
+class PtzStateCache {
+public:
+    /**
+     * @brief Read the cached PTZ.
+     *
+     * @param age seconds since the oldest of the three components was updated
+     * @return false if no complete PTZ has been cached yet
+     */
+    bool get(double& p, double& t, double& z, double& age);
+
+    // NaN components keep their cached value and timestamp.
+    void update(double p, double t, double z);
+    void invalidate();
+    // For moves that leave the zoom alone, e.g. a continuous pan/tilt.
+    void invalidate_pan_tilt();
+
+private:
+    std::mutex mutex_;
+    double p_ = NAN;
+    double t_ = NAN;
+    double z_ = NAN;
+    afl::Timestamp p_time_;
+    afl::Timestamp t_time_;
+    afl::Timestamp z_time_;
+};
+
+#endif // PTZ_STATE_CACHE_H
@@ -1,5 +1,9 @@
 #include "read_config.h"
 
+#include <gflags/gflags.h>
+
+DEFINE_string(config, "", "config file to read instead of <workroot>/etc/<process name>.cfg");
+
 ReadConfig::ReadConfig()
 {
     get_global_config();
@@ -14,7 +18,8 @@ ReadConfig& ReadConfig::getInstance()
 void ReadConfig::get_global_config()
 {
     std::string cfgstr;
-    afl::readFileAllDataToString(misc::getWorkrootPath() + "/etc/" + afl::getProcessName() + ".cfg", cfgstr);
+    const std::string path = FLAGS_config.empty() ? misc::getWorkrootPath() + "/etc/" + afl::getProcessName() + ".cfg" : FLAGS_config;
+    afl::readFileAllDataToString(path, cfgstr);
     Test test;
 
     auto ret = JsonHelper::jsonToObject(test, cfgstr);
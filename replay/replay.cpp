@@ -0,0 +1,163 @@
+/**
+ * @brief Replays a capture through ZmqInteractor and ControlContext and traces the camera commands.
+ *
+ * Every camera in the config is replaced by a TraceBallCamera and time comes from
+ * VirtualClock, which follows the receive times of the capture. Each message is
+ * handled to completion, timers included, before the next one goes in, so the trace
+ * only changes when the control code does and two builds can be compared with diff.
+ */
+#include "../capture_file.h"
+#include "../control_context.h"
+#include "../ptz_controller.h"
+#include "../read_config.h"
+#include "../trace_ball_camera.h"
+#include "../virtual_clock.h"
+#include "../zmq_interactor.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <net/EventLoop.h>
+#include <net/EventLoopThread.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <map>
+#include <thread>
+
+DEFINE_string(capture, "", "Capture segment or directory written with --capture_dir");
+DEFINE_string(trace, "", "Where the camera command trace goes, empty for stdout");
+DEFINE_double(speed, 0, "1 replays in real time, N at N times real time, 0 as fast as possible");
+DEFINE_string(focus, "", "Focus set at the start, as the cloud would: <focus_type>:<focus>, e.g. 1:京A12345 or 2:1024");
+DEFINE_string(focus_camera, "", "device_serial the focus goes to, empty for every camera");
+DEFINE_int32(settle_rounds, 3, "Loop and camera round trips after each message, enough for callbacks that post back to the loop");
+
+DECLARE_string(motion_model_dir);
+
+namespace {
+
+// Runs until the loop and every camera executor have nothing left to do.
+void settle(afl::net::EventLoop& loop, const std::map<std::string, std::shared_ptr<ControlContext>>& contexts)
+{
+    for (int round = 0; round < FLAGS_settle_rounds; ++round) {
+        std::promise<void> barrier;
+        loop.queueInLoop([&barrier]() { barrier.set_value(); });
+        barrier.get_future().wait();
+        for (const auto& ctx : contexts) {
+            ctx.second->wait_idle();
+        }
+    }
+}
+
+// Cameras issue commands on their own executors; per camera the order is fixed, across
+// cameras it is not, so lines are grouped by camera after every message.
+size_t flush_trace(FILE* out)
+{
+    std::vector<TraceBallCamera::Line> lines;
+    TraceBallCamera::take_lines(lines);
+    std::stable_sort(lines.begin(), lines.end(),
+        [](const TraceBallCamera::Line& a, const TraceBallCamera::Line& b) { return a.addr < b.addr; });
+    for (const auto& line : lines) {
+        fprintf(out, "%s\n", line.text.c_str());
+    }
+    return lines.size();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    LOG_IF(FATAL, FLAGS_capture.empty()) << "--capture is required";
+
+    capture::Reader reader(FLAGS_capture);
+    capture::Record record;
+    if (!reader.next(record)) {
+        LOG(ERROR) << "no records in " << FLAGS_capture;
+        return 1;
+    }
+
+    // 回放时球机瞬间到位, 不需要轮询间隔, 原地不动也很快判定到位, 跟踪时也不必观察转动; 学到的运动模型不能写回生产目录
+    gflags::SetCommandLineOption("settle_poll_min_ms", "0");
+    gflags::SetCommandLineOption("settle_poll_max_ms", "0");
+    gflags::SetCommandLineOption("settle_timeout", "0.05");
+    gflags::SetCommandLineOption("motion_observe_tracking", "false");
+    if (FLAGS_motion_model_dir.empty()) {
+        char dir[] = "/tmp/replay_motion_XXXXXX";
+        LOG_IF(FATAL, mkdtemp(dir) == nullptr) << "mkdtemp failed";
+        gflags::SetCommandLineOption("motion_model_dir", dir);
+    }
+
+    FILE* out = FLAGS_trace.empty() ? stdout : fopen(FLAGS_trace.c_str(), "w");
+    LOG_IF(FATAL, out == nullptr) << "open " << FLAGS_trace << " failed";
+
+    const int64_t start_us = record.wall_us;
+    VirtualClock::enable(afl::Timestamp(start_us));
+
+    afl::net::EventLoopThread thread;
+    auto& loop = thread.startLoop();
+    auto loop_ptr = std::shared_ptr<afl::net::EventLoop>(std::shared_ptr<void>(), &loop);
+
+    const auto& conf = ReadConfig::getInstance().config();
+    auto zmq = std::make_shared<ZmqInteractor>();
+    std::map<std::string, std::shared_ptr<ControlContext>> contexts;
+    for (auto c : conf.cameras) {
+        c.brand = "Trace";
+        c.addr = c.device_serial;
+        auto ptz = std::make_shared<PtzController>(c, conf.pid);
+        contexts[c.device_serial] = std::make_shared<ControlContext>(ptz, zmq, nullptr, loop_ptr);
+    }
+
+    // 关注目标平时由云端通过 MQTT 下发, 录制里没有, 由命令行给出
+    if (!FLAGS_focus.empty()) {
+        const auto colon = FLAGS_focus.find(':');
+        LOG_IF(FATAL, colon == std::string::npos) << "--focus should be <focus_type>:<focus>";
+        const int type = std::stoi(FLAGS_focus.substr(0, colon));
+        const std::string focus = FLAGS_focus.substr(colon + 1);
+        for (const auto& ctx : contexts) {
+            if (FLAGS_focus_camera.empty() || FLAGS_focus_camera == ctx.first) {
+                auto context = ctx.second;
+                loop.queueInLoop([context, type, focus]() { context->set_focus_method(type, focus); });
+            }
+        }
+    }
+    settle(loop, contexts);
+    flush_trace(out);
+
+    uint64_t messages = 0;
+    uint64_t commands = 0;
+    const auto wall_start = std::chrono::steady_clock::now();
+    do {
+        const int64_t offset_us = record.wall_us - start_us;
+        if (FLAGS_speed > 0) {
+            std::this_thread::sleep_until(wall_start + std::chrono::microseconds(static_cast<int64_t>(offset_us / FLAGS_speed)));
+        }
+
+        VirtualClock::advance_to(afl::Timestamp(record.wall_us), [&]() { settle(loop, contexts); });
+        // Frames are ordered per publisher, so each record goes back in as the one it came from.
+        const auto source = record.source < ZmqInteractor::SOURCES ? static_cast<ZmqInteractor::Source>(record.source) : ZmqInteractor::ALGO_RESULT;
+        zmq->inject(record.topic, record.topic_size, record.payload, record.payload_size, source);
+        settle(loop, contexts);
+        commands += flush_trace(out);
+        ++messages;
+    } while (reader.next(record));
+
+    const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    const double span = afl::timeDifference(VirtualClock::now(), afl::Timestamp(start_us));
+    fflush(out);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    const auto ingest = zmq->ingest_stats();
+    fprintf(stderr, "%llu messages over %.1fs replayed in %.2fs (%.0f msgs/s, %.1fx), %llu camera commands\n",
+        static_cast<unsigned long long>(messages), span, wall, messages / std::max(wall, 1e-9), span / std::max(wall, 1e-9),
+        static_cast<unsigned long long>(commands));
+    fprintf(stderr, "vehicle frames processed:%llu stale:%llu superseded:%llu future:%llu\n",
+        static_cast<unsigned long long>(ingest.processed), static_cast<unsigned long long>(ingest.stale),
+        static_cast<unsigned long long>(ingest.superseded), static_cast<unsigned long long>(ingest.future));
+
+    return 0;
+}
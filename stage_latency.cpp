@@ -0,0 +1,50 @@
+#include "stage_latency.h"
+
+#include <cstdio>
+
+void StageLatency::record(Stage stage, int64_t us)
+{
+    histograms_[stage].record(us);
+}
+
+StageLatency::Summary StageLatency::summary(Stage stage) const
+{
+    const auto& h = histograms_[stage];
+    Summary s;
+    s.count = h.count();
+    s.p50_ms = h.percentile(0.5) * 1e-3;
+    s.p90_ms = h.percentile(0.9) * 1e-3;
+    s.p99_ms = h.percentile(0.99) * 1e-3;
+    s.max_ms = h.max() * 1e-3;
+    return s;
+}
+
+const char* StageLatency::name(Stage stage)
+{
+    switch (stage) {
+    case SENSOR_TO_RECEIVE:
+        return "sensor_receive";
+    case RECEIVE_TO_MATCH:
+        return "receive_match";
+    case MATCH_TO_ISSUE:
+        return "match_issue";
+    case ISSUE_TO_ACK:
+        return "issue_ack";
+    default:
+        return "unknown";
+    }
+}
+
+std::string StageLatency::format() const
+{
+    std::string out;
+    for (int i = 0; i < STAGES; ++i) {
+        const auto stage = static_cast<Stage>(i);
+        const auto s = summary(stage);
+        char buf[160];
+        snprintf(buf, sizeof(buf), "%s%s n:%llu p50:%.1fms p90:%.1fms p99:%.1fms max:%.1fms", i == 0 ? "" : " | ",
+            name(stage), static_cast<unsigned long long>(s.count), s.p50_ms, s.p90_ms, s.p99_ms, s.max_ms);
+        out += buf;
+    }
+    return out;
+}
@@ -0,0 +1,50 @@
+#ifndef STAGE_LATENCY_H
+#define STAGE_LATENCY_H
+
+#include "latency_histogram.h"
+
+#include <string>
+
+/**
+ * @brief Where the time between a sensor seeing a target and the camera moving goes.
+ *
+ * One histogram per stage, per camera, since start-up:
+ *   SENSOR_TO_RECEIVE  participant timestamp to the ZMQ message arriving (fusion pipeline)
+ *   RECEIVE_TO_MATCH   arrival to the context matching the target (our queues and decoding)
+ *   MATCH_TO_ISSUE     match to the command being sent, including the mailbox wait and any position read
+ *   ISSUE_TO_ACK       the camera's HTTP round trip for the command
+ * SENSOR_TO_RECEIVE and RECEIVE_TO_MATCH are stamped with VirtualClock, so a replay
+ * measures them against the replayed time. Recording costs what LatencyHistogram::record
+ * does (a few relaxed atomics, no lock) and can be left on; summaries can be taken from
+ * any thread.
+ */
+class StageLatency {
+public:
+    enum Stage {
+        SENSOR_TO_RECEIVE = 0,
+        RECEIVE_TO_MATCH,
+        MATCH_TO_ISSUE,
+        ISSUE_TO_ACK,
+        STAGES
+    };
+
+    struct Summary {
+        uint64_t count = 0;
+        double p50_ms = 0;
+        double p90_ms = 0;
+        double p99_ms = 0;
+        double max_ms = 0;
+    };
+
+    void record(Stage stage, int64_t us);
+    Summary summary(Stage stage) const;
+
+    static const char* name(Stage stage);
+    // One line for the log: "<stage> n:.. p50:..ms p90:..ms p99:..ms max:..ms" per stage.
+    std::string format() const;
+
+private:
+    LatencyHistogram histograms_[STAGES];
+};
+
+#endif // STAGE_LATENCY_H
@@ -0,0 +1,128 @@
+#include "trace_ball_camera.h"
+#include "virtual_clock.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+std::mutex lines_mutex_;
+std::vector<TraceBallCamera::Line> lines_;
+uint64_t commands_ = 0;
+std::atomic<bool> recording_ { true };
+
+void preset_position(uint64_t preset_id, double& p, double& t, double& z)
+{
+    p = static_cast<double>((preset_id * 37) % 360);
+    t = 10.0 + static_cast<double>(preset_id % 8) * 5.0;
+    z = 1.0;
+}
+
+std::string format(const char* fmt, double a, double b, double c)
+{
+    char buf[96];
+    snprintf(buf, sizeof(buf), fmt, a, b, c);
+    return buf;
+}
+
+} // namespace
+
+TraceBallCamera::TraceBallCamera(std::string addr, uint64_t id, BallCameraCapability capability)
+    : BallCamera(addr, id, capability)
+{
+    preset_position(id, p_, t_, z_);
+}
+
+bool TraceBallCamera::get_ptz(double& p, double& t, double& z)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    advance();
+    p = p_;
+    t = t_;
+    z = z_;
+    return true;
+}
+
+bool TraceBallCamera::set_ptz(double p, double t, double z)
+{
+    trace("set_ptz", format("%.3f %.3f %.3f", p, t, z));
+    std::lock_guard<std::mutex> lock(mutex_);
+    advance();
+    p_ = std::isnan(p) ? p_ : std::fmod(p + 360.0, 360.0);
+    t_ = std::isnan(t) ? t_ : t;
+    z_ = std::isnan(z) ? z_ : z;
+    vp_ = vt_ = 0;
+    return true;
+}
+
+bool TraceBallCamera::go_to_preset(const uint64_t& preset_id)
+{
+    trace("go_to_preset", std::to_string(preset_id));
+    std::lock_guard<std::mutex> lock(mutex_);
+    preset_position(preset_id, p_, t_, z_);
+    vp_ = vt_ = 0;
+    moved_ = VirtualClock::now();
+    return true;
+}
+
+bool TraceBallCamera::snapshot(std::string& pic)
+{
+    trace("snapshot", "");
+    return false;
+}
+
+bool TraceBallCamera::continuous_move(double pan_speed, double tilt_speed)
+{
+    trace("continuous_move", format("%.3f %.3f", pan_speed, tilt_speed, 0));
+    std::lock_guard<std::mutex> lock(mutex_);
+    advance();
+    vp_ = pan_speed;
+    vt_ = tilt_speed;
+    return true;
+}
+
+void TraceBallCamera::take_lines(std::vector<Line>& lines)
+{
+    std::lock_guard<std::mutex> lock(lines_mutex_);
+    lines.insert(lines.end(), lines_.begin(), lines_.end());
+    lines_.clear();
+}
+
+uint64_t TraceBallCamera::commands()
+{
+    std::lock_guard<std::mutex> lock(lines_mutex_);
+    return commands_;
+}
+
+void TraceBallCamera::set_recording(bool on)
+{
+    recording_ = on;
+}
+
+void TraceBallCamera::trace(const char* command, const std::string& args)
+{
+    if (!recording_) {
+        return;
+    }
+
+    std::string text = std::to_string(VirtualClock::now().milliSecondsSinceEpoch()) + " " + addr_ + " " + command;
+    if (!args.empty()) {
+        text += " " + args;
+    }
+
+    std::lock_guard<std::mutex> lock(lines_mutex_);
+    lines_.push_back(Line { addr_, std::move(text) });
+    ++commands_;
+}
+
+void TraceBallCamera::advance()
+{
+    const auto now = VirtualClock::now();
+    if (moved_.valid()) {
+        const double elapsed = afl::timeDifference(now, moved_);
+        p_ = std::fmod(p_ + vp_ * elapsed + 360.0, 360.0);
+        t_ += vt_ * elapsed;
+    }
+    moved_ = now;
+}
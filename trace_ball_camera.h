@@ -0,0 +1,52 @@
+#ifndef TRACE_BALL_CAMERA_H
+#define TRACE_BALL_CAMERA_H
+
+#include "ball_camera.h"
+
+#include <base/Timestamp.h>
+
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief A camera that moves instantly and logs every command it is given.
+ *
+ * Brand "Trace". Each command becomes a line "<virtual ms> <addr> <command> <args>"
+ * in a process wide trace, so the commands of two runs over the same capture can be
+ * diffed. Preset n sits at a fixed position derived from n.
+ */
+class TraceBallCamera : public BallCamera {
+public:
+    TraceBallCamera(std::string addr, uint64_t id, BallCameraCapability capability);
+
+    virtual bool get_ptz(double& p, double& t, double& z) override;
+    virtual bool set_ptz(double p, double t, double z) override;
+    virtual bool go_to_preset(const uint64_t& preset_id) override;
+    virtual bool snapshot(std::string& pic) override;
+    virtual bool continuous_move(double pan_speed, double tilt_speed) override;
+
+    struct Line {
+        std::string addr;
+        std::string text;
+    };
+    // Moves the lines traced so far into lines, in the order each camera issued them.
+    static void take_lines(std::vector<Line>& lines);
+    static uint64_t commands();
+    // Off: commands still move the camera but are neither kept nor counted, for benchmarks.
+    static void set_recording(bool on);
+
+private:
+    void trace(const char* command, const std::string& args);
+    void advance(); // applies the continuous move up to now
+
+private:
+    std::mutex mutex_;
+    double p_ = 0;
+    double t_ = 0;
+    double z_ = 1;
+    double vp_ = 0;
+    double vt_ = 0;
+    afl::Timestamp moved_;
+};
+
+#endif // TRACE_BALL_CAMERA_H
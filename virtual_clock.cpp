@@ -0,0 +1,96 @@
+#include "virtual_clock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace {
+
+struct Timer {
+    afl::net::EventLoop* loop;
+    double interval; // 0 for one shot
+    std::function<void()> fn;
+};
+
+std::atomic<bool> enabled_ { false };
+std::atomic<int64_t> now_us_ { 0 };
+
+std::mutex timers_mutex_;
+// Keyed by (deadline, insertion order), so equal deadlines fire in the order they were set.
+std::map<std::pair<int64_t, uint64_t>, Timer> timers_;
+uint64_t timer_seq_ = 0;
+
+void schedule(int64_t deadline, Timer timer)
+{
+    std::lock_guard<std::mutex> lock(timers_mutex_);
+    timers_.emplace(std::make_pair(deadline, timer_seq_++), std::move(timer));
+}
+
+} // namespace
+
+afl::Timestamp VirtualClock::now()
+{
+    if (enabled_) {
+        return afl::Timestamp(now_us_);
+    }
+    return afl::Timestamp::now();
+}
+
+void VirtualClock::run_after(afl::net::EventLoop& loop, double delay, std::function<void()> fn)
+{
+    if (!enabled_) {
+        loop.runAfter(delay, std::move(fn));
+        return;
+    }
+    schedule(now_us_ + static_cast<int64_t>(delay * 1e6), Timer { &loop, 0, std::move(fn) });
+}
+
+void VirtualClock::run_every(afl::net::EventLoop& loop, double interval, std::function<void()> fn)
+{
+    if (!enabled_) {
+        loop.runEvery(interval, std::move(fn));
+        return;
+    }
+    schedule(now_us_ + static_cast<int64_t>(interval * 1e6), Timer { &loop, interval, std::move(fn) });
+}
+
+void VirtualClock::enable(afl::Timestamp start)
+{
+    now_us_ = start.microSecondsSinceEpoch();
+    enabled_ = true;
+}
+
+bool VirtualClock::enabled()
+{
+    return enabled_;
+}
+
+void VirtualClock::advance_to(afl::Timestamp t, const std::function<void()>& settle)
+{
+    const int64_t target = t.microSecondsSinceEpoch();
+    while (true) {
+        Timer timer;
+        int64_t deadline = 0;
+        {
+            std::lock_guard<std::mutex> lock(timers_mutex_);
+            auto first = timers_.begin();
+            if (first == timers_.end() || first->first.first > target) {
+                break;
+            }
+            deadline = first->first.first;
+            timer = std::move(first->second);
+            timers_.erase(first);
+        }
+
+        now_us_ = std::max<int64_t>(now_us_, deadline);
+        if (timer.interval > 0) {
+            schedule(deadline + static_cast<int64_t>(timer.interval * 1e6), timer);
+        }
+        timer.loop->queueInLoop(timer.fn);
+        settle();
+    }
+
+    now_us_ = std::max<int64_t>(now_us_, target);
+}
@@ -0,0 +1,33 @@
+#ifndef VIRTUAL_CLOCK_H
+#define VIRTUAL_CLOCK_H
+
+#include <base/Timestamp.h>
+#include <net/EventLoop.h>
+
+#include <functional>
+
+/**
+ * @brief The time control decisions are made by.
+ *
+ * Normally this is afl::Timestamp::now() and real loop timers. A replay enables it
+ * with the capture's start time and then moves it forward itself: now() returns the
+ * replayed time and run_after/run_every timers fire from advance_to(), in deadline
+ * order, so a replay makes the same decisions however fast it runs.
+ */
+class VirtualClock {
+public:
+    static afl::Timestamp now();
+
+    // fn runs on loop after delay seconds, or every interval seconds.
+    static void run_after(afl::net::EventLoop& loop, double delay, std::function<void()> fn);
+    static void run_every(afl::net::EventLoop& loop, double interval, std::function<void()> fn);
+
+    // Replay side. Call enable() before anything reads the clock.
+    static void enable(afl::Timestamp start);
+    static bool enabled();
+    // Fires every timer due by t, calling settle() after each so its effects land
+    // before the next one, then sets the clock to t.
+    static void advance_to(afl::Timestamp t, const std::function<void()>& settle);
+};
+
+#endif // VIRTUAL_CLOCK_H
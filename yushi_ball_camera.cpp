@@ -1,65 +1,125 @@
 #include "yushi_ball_camera.h"
+#include "lapi_session.h"
 #include "read_config.h"
 #include <nlohmann/json.hpp>
 
-#define CPPHTTPLIB_OPENSSL_SUPPORT
-#include "httplib.h"
+#include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <future>
 
 using namespace httplib;
 
-YuShiBallCamera::YuShiBallCamera(std::string addr, uint64_t id)
-    : BallCamera(addr, id)
+DEFINE_double(yushi_speed_per_level, 5.0, "Pan/tilt degree/s of one PTZCtrl speed level");
+
+YuShiBallCamera::YuShiBallCamera(std::string addr, uint64_t id, BallCameraCapability capability)
+    : BallCamera(addr, id, capability)
 {
     const auto& conn = ReadConfig::getInstance().config().connConfig;
     user_ = conn.camera_username.size() == 0 ? "admin" : conn.camera_username;
     pswd_ = conn.camera_passward.size() == 0 ? "Ab123456" : conn.camera_passward;
+
+    // addr may carry a port, e.g. 127.0.0.1:18000 for the camera simulator
+    std::string host = addr_;
+    int port = 80;
+    auto pos = addr_.rfind(':');
+    if (pos != std::string::npos) {
+        host = addr_.substr(0, pos);
+        port = std::stoi(addr_.substr(pos + 1));
+    }
+    session_.reset(new LapiSession(host, port, user_, pswd_));
+    zoom_session_.reset(new LapiSession(host, port, user_, pswd_));
 }
 
+YuShiBallCamera::~YuShiBallCamera() = default;
+
 bool YuShiBallCamera::get_ptz(double& p, double& t, double& z)
+{
+    return guarded("get_ptz", [&]() { return lapi_get_ptz(p, t, z); });
+}
+
+bool YuShiBallCamera::set_ptz(double p, double t, double z)
+{
+    return guarded("set_ptz", [&]() { return lapi_set_ptz(p, t, z); });
+}
+
+bool YuShiBallCamera::go_to_preset(const uint64_t& preset_id)
+{
+    return guarded("go_to_preset", [&]() { return lapi_go_to_preset(preset_id); });
+}
+
+bool YuShiBallCamera::snapshot(std::string& pic)
+{
+    return guarded("snapshot", [&]() { return lapi_snapshot(pic); });
+}
+
+bool YuShiBallCamera::continuous_move(double pan_speed, double tilt_speed)
+{
+    return guarded("continuous_move", [&]() { return lapi_continuous_move(pan_speed, tilt_speed); });
+}
+
+/**
+ * @brief PTZCtrl only knows speed levels 1 ~ 9, a rate that rounds to level 0 stops.
+ */
+void YuShiBallCamera::actual_speed(double& pan_speed, double& tilt_speed)
+{
+    pan_speed = std::copysign(speed_level(pan_speed) * FLAGS_yushi_speed_per_level, pan_speed);
+    tilt_speed = std::copysign(speed_level(tilt_speed) * FLAGS_yushi_speed_per_level, tilt_speed);
+}
+
+int YuShiBallCamera::speed_level(double speed)
+{
+    return std::min(9, static_cast<int>(std::lround(std::fabs(speed) / FLAGS_yushi_speed_per_level)));
+}
+
+bool YuShiBallCamera::lapi_get_ptz(double& p, double& t, double& z)
 {
     /*
      *     /LAPI/V1.0/Channels/<ID>/PTZ/AbsoluteMove
      *     /LAPI/V1.0/Channels/<ID>/PTZ/AbsoluteZoom
      */
 
-    int retry_cnt = 3;
-    while (retry_cnt-- > 0) {
-        try {
-            httplib::Client cli(addr_, 80);
-            cli.set_digest_auth(user_.c_str(), pswd_.c_str());
-
-            const std::string url_move = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteMove";
-            const std::string url_zoom = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteZoom";
-
-            auto receive_move = cli.Get(url_move.c_str());
-            auto receive_zoom = cli.Get(url_zoom.c_str());
-
-            if (receive_move && receive_zoom && receive_move->status == 200 && receive_zoom->status == 200) {
-                auto body_move = nlohmann::json::parse(receive_move->body);
-                auto body_zoom = nlohmann::json::parse(receive_zoom->body);
-
-                double lon = body_move["Response"]["Data"]["Longitude"];
-                double lat = body_move["Response"]["Data"]["Latitude"];
-                double zoom = body_zoom["Response"]["Data"]["ZoomRatio"];
-
-                // Need to do something else
-                p = lon;
-                t = lat;
-                z = zoom;
-                LOG(INFO) << "Get PTZ success." << p << " " << t << " " << z;
-                return true;
-            }
-            LOG(INFO) << "Preset failure, retry cnt:" << retry_cnt;
-        } catch (const std::exception& e) {
-            LOG(ERROR) << "get PTZ failure! " << e.what();
+    // No retry here: a failed call goes to the circuit breaker, which decides when to try again.
+    try {
+        const std::string url_move = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteMove";
+        const std::string url_zoom = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteZoom";
+
+        auto receive_move = session_->get(url_move);
+        if (!receive_move || receive_move->status != 200) {
+            LOG(INFO) << addr_ << " get PT failure.";
+            return false;
         }
+        auto receive_zoom = session_->get(url_zoom);
+        if (!receive_zoom || receive_zoom->status != 200) {
+            LOG(INFO) << addr_ << " get Z failure.";
+            return false;
+        }
+
+        parse_ptz(receive_move->body, receive_zoom->body, p, t, z);
+        LOG(INFO) << "Get PTZ success." << p << " " << t << " " << z;
+        return true;
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "get PTZ failure! " << e.what();
     }
 
     return false;
 }
 
-bool YuShiBallCamera::set_ptz(double p, double t, double z)
+void YuShiBallCamera::parse_ptz(const std::string& move_body, const std::string& zoom_body, double& p, double& t, double& z)
+{
+    auto body_move = nlohmann::json::parse(move_body);
+    auto body_zoom = nlohmann::json::parse(zoom_body);
+
+    double lon = body_move["Response"]["Data"]["Longitude"];
+    double lat = body_move["Response"]["Data"]["Latitude"];
+    double zoom = body_zoom["Response"]["Data"]["ZoomRatio"];
+
+    // Need to do something else
+    p = lon;
+    t = lat;
+    z = zoom;
+}
+
+bool YuShiBallCamera::lapi_set_ptz(double p, double t, double z)
 {
     /*
      *     /LAPI/V1.0/Channels/<ID>/PTZ/AbsoluteMove
@@ -69,110 +129,154 @@ bool YuShiBallCamera::set_ptz(double p, double t, double z)
     LOG(INFO) << addr_ << " begin turning to :"
               << "p:" << p << " t:" << t << " z:" << z;
 
-    bool setpt = std::isnan(p) || std::isnan(t);
-    bool setz = std::isnan(z);
-
-    int retry_cnt = 3;
-    while (retry_cnt-- > 0 && !setpt) {
-        try {
-            httplib::Client cli(addr_, 80);
-            cli.set_digest_auth(user_.c_str(), pswd_.c_str());
-
-            const std::string url_move = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteMove";
-            nlohmann::json data_move;
-            data_move["Longitude"] = p;
-            data_move["Latitude"] = t;
-            std::string input_move = data_move.dump();
-            auto receive_move = cli.Put(url_move.c_str(), input_move.c_str(), input_move.size(), "text/plain");
-
-            if (receive_move && receive_move->status == 200) {
-                LOG(INFO) << "set PT success! P:" << p << " T:" << t;
-                setpt = true;
-                break;
-            }
-
-            LOG(INFO) << "set PT failure P:" << p << " T:" << t << " retry cnt:" << retry_cnt;
-        } catch (const std::exception& e) {
-            LOG(ERROR) << "set PTZ failure! " << e.what();
-        }
+    bool skippt = std::isnan(p) || std::isnan(t);
+    bool skipz = std::isnan(z);
+
+    if (skippt || skipz) {
+        return (skippt || set_pt(*session_, p, t, NAN)) && (skipz || set_z(*zoom_session_, z));
     }
 
-    retry_cnt = 3;
-    while (retry_cnt-- > 0 && !setz) {
-        try {
-            httplib::Client cli(addr_, 80);
-            cli.set_digest_auth(user_.c_str(), pswd_.c_str());
-
-            std::string url_zoom = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteZoom";
-            nlohmann::json data_zoom;
-            data_zoom["ZoomRatio"] = z;
-            std::string input_zoom = data_zoom.dump();
-            auto receive_zoom = cli.Put(url_zoom.c_str(), input_zoom.c_str(), input_zoom.size(), "text/plain");
-
-            if (receive_zoom && receive_zoom->status == 200) {
-                LOG(INFO) << "set Z success, Z:" << z << " retry cnt:" << retry_cnt;
-                setz = true;
-                break;
-            }
-        } catch (const std::exception& e) {
-            LOG(ERROR) << "set PTZ failure! " << e.what();
+    if (capability_.combined_ptz) {
+        return set_pt(*session_, p, t, z);
+    }
+
+    // Both halves at once, each on its own connection.
+    auto setz = std::async(std::launch::async, [this, z]() { return set_z(*zoom_session_, z); });
+    bool setpt = set_pt(*session_, p, t, NAN);
+    return setz.get() && setpt;
+}
+
+/**
+ * @brief PUT AbsoluteMove, with the zoom in the same body if z is given.
+ */
+bool YuShiBallCamera::set_pt(LapiSession& session, double p, double t, double z)
+{
+    try {
+        const std::string url_move = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteMove";
+        nlohmann::json data_move;
+        data_move["Longitude"] = p;
+        data_move["Latitude"] = t;
+        if (!std::isnan(z)) {
+            data_move["ZoomRatio"] = z;
         }
+        std::string input_move = data_move.dump();
+        auto receive_move = session.put(url_move, input_move);
+
+        if (receive_move && receive_move->status == 200) {
+            LOG(INFO) << "set PT success! P:" << p << " T:" << t;
+            return true;
+        }
+
+        LOG(INFO) << "set PT failure P:" << p << " T:" << t;
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "set PTZ failure! " << e.what();
     }
+    return false;
+}
+
+bool YuShiBallCamera::set_z(LapiSession& session, double z)
+{
+    try {
+        std::string url_zoom = "/LAPI/V1.0/Channels/0/PTZ/AbsoluteZoom";
+        nlohmann::json data_zoom;
+        data_zoom["ZoomRatio"] = z;
+        std::string input_zoom = data_zoom.dump();
+        auto receive_zoom = session.put(url_zoom, input_zoom);
+
+        if (receive_zoom && receive_zoom->status == 200) {
+            LOG(INFO) << "set Z success, Z:" << z;
+            return true;
+        }
 
-    return (setpt && setz);
+        LOG(INFO) << "set Z failure Z:" << z;
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "set PTZ failure! " << e.what();
+    }
+    return false;
 }
 
-bool YuShiBallCamera::go_to_preset(const uint64_t& preset_id)
+bool YuShiBallCamera::lapi_go_to_preset(const uint64_t& preset_id)
 {
     std::string str_id = std::to_string(preset_id);
     LOG(INFO) << addr_ << " begin turning to preset_" + str_id;
 
-    int retry_cnt = 3;
-    while (retry_cnt-- > 0) {
-        try {
-            httplib::Client cli(addr_, 80);
-            cli.set_digest_auth(user_.c_str(), pswd_.c_str());
-
-            const std::string url = "/LAPI/V1.0/Channels/0/PTZ/Presets/" + str_id + "/Goto";
-            auto response = cli.Put(url.c_str());
-
-            if (response && response->status == 200) {
-                LOG(INFO) << "Move to preset" << str_id << " success.";
-                return true;
-            } else {
-                LOG(INFO) << "Move to preset" << str_id << " failure. Retry cnt:" << retry_cnt;
-            }
-        } catch (const std::exception& e) {
-            LOG(ERROR) << "Move to preset" << str_id << " failure." << e.what();
+    try {
+        const std::string url = "/LAPI/V1.0/Channels/0/PTZ/Presets/" + str_id + "/Goto";
+        auto response = session_->put(url);
+
+        if (response && response->status == 200) {
+            LOG(INFO) << "Move to preset" << str_id << " success.";
+            return true;
+        } else {
+            LOG(INFO) << "Move to preset" << str_id << " failure.";
         }
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "Move to preset" << str_id << " failure." << e.what();
     }
     return false;
 }
 
-bool YuShiBallCamera::snapshot(std::string& pic)
+bool YuShiBallCamera::lapi_snapshot(std::string& pic)
 {
     LOG(INFO) << addr_ << " Begin to Snapshot";
 
-    int retry_cnt = 3;
+    try {
+        const std::string url = "/LAPI/V1.0/Channels/0/Media/Video/Streams/0/Snapshot";
+        auto response = session_->get(url);
 
-    while (retry_cnt-- > 0) {
-        try {
-            httplib::Client cli(addr_, 80);
-            cli.set_digest_auth(user_.c_str(), pswd_.c_str());
+        if (response && response->status == 200) {
+            pic = response->body;
+            return true;
+        } else {
+            LOG(INFO) << addr_ << " snapshot fail.";
+        }
+    } catch (const std::exception& e) {
+        LOG(ERROR) << addr_ << " snapshot fail." << e.what();
+    }
 
-            const std::string url = "/LAPI/V1.0/Channels/0/Media/Video/Streams/0/Snapshot";
-            auto response = cli.Get(url.c_str());
+    return false;
+}
 
-            if (response && response->status == 200) {
-                pic = response->body;
-                return true;
-            } else {
-                LOG(INFO) << addr_ << " snapshot fail. Retry cnt:" << retry_cnt;
-            }
-        } catch (const std::exception& e) {
-            LOG(ERROR) << addr_ << " snapshot fail." << e.what();
-        }
+bool YuShiBallCamera::lapi_continuous_move(double pan_speed, double tilt_speed)
+{
+    /*
+     *     /LAPI/V1.0/Channels/<ID>/PTZ/PTZCtrl
+     *     PTZCmd: 0x0402 up, 0x0404 down, 0x0502 right, 0x0504 left, 0x0702 left up,
+     *             0x0704 left down, 0x0802 right up, 0x0804 right down, 0x0901 stop
+     *     Para1, Para2: pan and tilt speed level, 1 ~ 9
+     */
+
+    const int pan_level = speed_level(pan_speed);
+    const int tilt_level = speed_level(tilt_speed);
+
+    // A positive tilt looks further down, a positive pan turns clockwise.
+    int cmd = 0x0901;
+    if (pan_level > 0 && tilt_level > 0) {
+        cmd = pan_speed > 0 ? (tilt_speed > 0 ? 0x0804 : 0x0802) : (tilt_speed > 0 ? 0x0704 : 0x0702);
+    } else if (pan_level > 0) {
+        cmd = pan_speed > 0 ? 0x0502 : 0x0504;
+    } else if (tilt_level > 0) {
+        cmd = tilt_speed > 0 ? 0x0404 : 0x0402;
     }
 
+    try {
+        const std::string url = "/LAPI/V1.0/Channels/0/PTZ/PTZCtrl";
+        nlohmann::json data;
+        data["PTZCmd"] = cmd;
+        data["ContinueTime"] = 0;
+        data["Para1"] = pan_level;
+        data["Para2"] = tilt_level;
+        data["Para3"] = 0;
+        std::string input = data.dump();
+        auto response = session_->put(url, input);
+
+        if (response && response->status == 200) {
+            VLOG(1) << addr_ << " continuous move cmd:" << cmd << " pan:" << pan_level << " tilt:" << tilt_level;
+            return true;
+        }
+        LOG(INFO) << addr_ << " continuous move failure.";
+    } catch (const std::exception& e) {
+        LOG(ERROR) << addr_ << " continuous move failure. " << e.what();
+    }
     return false;
-}
\ No newline at end of file
+}
@@ -3,18 +3,38 @@
 
 #include "ball_camera.h"
 
+class LapiSession;
+
 class YuShiBallCamera : public BallCamera {
 public:
-    YuShiBallCamera(std::string addr, uint64_t id);
+    YuShiBallCamera(std::string addr, uint64_t id, BallCameraCapability capability);
+    ~YuShiBallCamera();
 
     virtual bool get_ptz(double& p, double& t, double& z) override;
     virtual bool set_ptz(double p, double t, double z) override;
     virtual bool go_to_preset(const uint64_t& preset_id) override;
     virtual bool snapshot(std::string& pic) override;
+    virtual bool continuous_move(double pan_speed, double tilt_speed) override;
+    virtual void actual_speed(double& pan_speed, double& tilt_speed) override;
+
+    // The p/t/z of AbsoluteMove and AbsoluteZoom GET responses, throws on a malformed body.
+    static void parse_ptz(const std::string& move_body, const std::string& zoom_body, double& p, double& t, double& z);
+
+private:
+    bool lapi_get_ptz(double& p, double& t, double& z);
+    bool lapi_set_ptz(double p, double t, double z);
+    bool lapi_go_to_preset(const uint64_t& preset_id);
+    bool lapi_snapshot(std::string& pic);
+    bool lapi_continuous_move(double pan_speed, double tilt_speed);
+    bool set_pt(LapiSession& session, double p, double t, double z);
+    bool set_z(LapiSession& session, double z);
+    static int speed_level(double speed);
 
 private:
     std::string user_;
     std::string pswd_;
+    std::unique_ptr<LapiSession> session_;
+    std::unique_ptr<LapiSession> zoom_session_; // lets zoom go out alongside pan/tilt
 };
 
 #endif // YUSHI_BALL_CAMERA_H
\ No newline at end of file
@@ -1,11 +1,24 @@
 #include "zmq_interactor.h"
+#include "capture_file.h"
+#include "participant_decoder.h"
+#include "virtual_clock.h"
 
+#include <algorithm>
+#include <base/Timestamp.h>
 #include <common/appprotocol.h>
+#include <gflags/gflags.h>
 #include <iomanip>
 #include <iostream>
 #include <mmw/mmwfactory.h>
 #include <mutex>
 
+DEFINE_int32(max_frame_age_ms, 2000, "vehicle frames older than this (newest ptc.timestamp to now) are dropped, 0 keeps all");
+DEFINE_int32(max_frame_skew_ms, 500, "vehicle frame timestamps may run ahead of the local clock by this much before they are distrusted");
+DEFINE_string(capture_dir, "", "record every received vehicle and event message into capture segments here, empty to disable");
+DEFINE_int32(capture_segment_mb, 256, "size of one capture segment file");
+DEFINE_bool(selective_decode, true, "decode only the participant fields control uses, instead of ParseFromArray");
+DEFINE_double(route_cell_size, 200.0, "cell size of the camera coverage grid, in meters");
+
 using namespace v2x;
 using namespace std::placeholders;
 extern std::unordered_map<std::string, std::shared_ptr<ControlContext>> controlContexts;
@@ -13,23 +26,47 @@ extern std::unordered_map<std::string, ControlCommand> cmds;
 extern std::mutex mttx;
 
 ZmqInteractor::ZmqInteractor()
+    : routes_(std::make_shared<VehicleRoutes>(FLAGS_route_cell_size))
 {
+    if (!FLAGS_capture_dir.empty()) {
+        recorder_.reset(new capture::Recorder(FLAGS_capture_dir, static_cast<size_t>(FLAGS_capture_segment_mb) << 20));
+        LOG(INFO) << "capture ZMQ messages into " << FLAGS_capture_dir;
+    }
 }
 
+ZmqInteractor::~ZmqInteractor() = default;
+
 void ZmqInteractor::startZMQ()
 {
-    // subscriberPtr_ = afl::MMWFactory().getSubscriber(afl::MMWSelector::ZMQ, std::set<std::string>{algoResultPublisherAddr, sensorPublisherAddr});
-    subscriberPtr_ = afl::MMWFactory().getSubscriber(afl::MMWSelector::ZMQ, std::set<std::string> { algoResultPublisherAddr, sensorPublisherAddr });
-    LOG_IF(FATAL, subscriberPtr_ == nullptr) << "This MQ type is not supported!";
-    LOG_IF(FATAL, subscriberPtr_->init() == false) << "MQ init return false!";
-    LOG_IF(ERROR, subscriberPtr_->subscribe(algoTargetTopic) == false) << "subscribe " << algoTargetTopic << " return false!";
-    LOG_IF(ERROR, subscriberPtr_->subscribe(receivedRadarEventsTopic) == false) << "subscribe " << algoTargetTopic << " return false!";
-    LOG_IF(FATAL, subscriberPtr_->readStart(std::bind(&ZmqInteractor::onMessageHandler, this, _1, _2, _3, _4)) == false) << "subscriber readStart return false!";
+    // One subscriber per publisher instead of one merging both, so the handler knows
+    // where a frame came from and ordering is only compared within a publisher.
+    const std::string publishers[SOURCES] = { algoResultPublisherAddr, sensorPublisherAddr };
+    for (int source = 0; source < SOURCES; ++source) {
+        auto subscriber = afl::MMWFactory().getSubscriber(afl::MMWSelector::ZMQ, std::set<std::string> { publishers[source] });
+        LOG_IF(FATAL, subscriber == nullptr) << "This MQ type is not supported!";
+        LOG_IF(FATAL, subscriber->init() == false) << "MQ init return false!";
+        LOG_IF(ERROR, subscriber->subscribe(algoTargetTopic) == false) << "subscribe " << algoTargetTopic << " return false!";
+        LOG_IF(ERROR, subscriber->subscribe(receivedRadarEventsTopic) == false) << "subscribe " << algoTargetTopic << " return false!";
+        LOG_IF(FATAL, subscriber->readStart(std::bind(&ZmqInteractor::onMessageHandler, this, static_cast<Source>(source), _1, _2, _3, _4)) == false)
+            << "subscriber readStart return false!";
+        subscribers_.push_back(subscriber);
+    }
+}
+
+uint32_t ZmqInteractor::set_vehicles_callback(VehicleMessageCallback cb, double x, double y, double radius)
+{
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    auto routes = std::make_shared<VehicleRoutes>(*routes_);
+    const auto subscriber = static_cast<uint32_t>(routes->callbacks.size());
+    routes->grid.add(subscriber, x, y, radius);
+    routes->callbacks.push_back(std::move(cb));
+    routes_ = routes;
+    return subscriber;
 }
 
-void ZmqInteractor::set_vehicles_callback(VehicleMessageCallback cb)
+void ZmqInteractor::set_focus(uint32_t subscriber, int type, const std::string& focus)
 {
-    slots_.push_back(vehicle_signal_.connect(std::move(cb)));
+    focus_index_.set(subscriber, type, focus);
 }
 
 void ZmqInteractor::set_evnets_callback(EventMessageCallback cb)
@@ -37,18 +74,152 @@ void ZmqInteractor::set_evnets_callback(EventMessageCallback cb)
     slots_.push_back(event_signal_.connect(std::move(cb)));
 }
 
+void ZmqInteractor::inject(const char* topic, size_t topicSize, const char* content, size_t contentSize, Source source)
+{
+    onMessageHandler(source, topic, topicSize, content, contentSize);
+}
+
+ZmqInteractor::IngestStats ZmqInteractor::ingest_stats() const
+{
+    return IngestStats { processed_, stale_, superseded_, future_,
+        age_.percentile(0.5) / 1000, age_.percentile(0.99) / 1000, age_.max() / 1000 };
+}
+
+// Drops frames that are too old to steer by, or older than one already routed from
+// the same publisher. A frame stamped ahead of the local clock is routed, but only
+// raises the publisher's mark up to now + --max_frame_skew_ms, so one bad timestamp
+// cannot shut out the valid frames behind it.
+bool ZmqInteractor::admit(Source source, const ParticipantFrame& frame)
+{
+    if (0 == frame.size()) {
+        ++processed_;
+        return true;
+    }
+
+    const int64_t now_ms = VirtualClock::now().milliSecondsSinceEpoch();
+    const int64_t age_ms = now_ms - static_cast<int64_t>(frame.newest);
+    age_.record(age_ms * 1000);
+
+    if (FLAGS_max_frame_age_ms > 0 && age_ms > FLAGS_max_frame_age_ms) {
+        ++stale_;
+        LOG_EVERY_N(WARNING, 100) << "drop stale vehicle frame, age_ms:" << age_ms << " stale frames:" << stale_;
+        return false;
+    }
+
+    uint64_t& newest_routed = newest_routed_[source];
+    if (frame.newest < newest_routed) {
+        ++superseded_;
+        VLOG(2) << "drop superseded vehicle frame, " << newest_routed - frame.newest << "ms older than the last one";
+        return false;
+    }
+
+    const uint64_t latest_trusted = static_cast<uint64_t>(now_ms + std::max(FLAGS_max_frame_skew_ms, 0));
+    if (frame.newest > latest_trusted) {
+        ++future_;
+        LOG_EVERY_N(WARNING, 100) << "vehicle frame " << -age_ms << "ms ahead of the local clock, future frames:" << future_;
+    }
+
+    newest_routed = std::min(frame.newest, latest_trusted);
+    ++processed_;
+    return true;
+}
+
+std::shared_ptr<ParticipantBatch> ZmqInteractor::acquire_batch()
+{
+    // Each control loop holds at most a pending and an in-flight batch, so the
+    // pool stays bounded by twice the number of contexts.
+    thread_local std::vector<std::shared_ptr<ParticipantBatch>> pool;
+    for (auto& batch : pool) {
+        if (batch.use_count() == 1) {
+            return batch;
+        }
+    }
+
+    pool.push_back(std::make_shared<ParticipantBatch>());
+    return pool.back();
+}
+
+bool ZmqInteractor::decode_vehicles(const char* content, size_t contentSize, ParticipantBatch& batch)
+{
+    static const ParticipantDecoder decoder;
+    if (FLAGS_selective_decode && decoder.decode(content, contentSize, batch.frame)) {
+        return true;
+    }
+
+    if (!batch.infos.ParseFromArray(content, contentSize)) {
+        return false;
+    }
+    batch.frame.assign(batch.infos);
+    return true;
+}
+
 // notice: This is a multithreaded function. So use the mutex lock on shared variables.
-void ZmqInteractor::onMessageHandler(const char* topic, size_t topicSize, const char* content, size_t contentSize)
+void ZmqInteractor::onMessageHandler(Source source, const char* topic, size_t topicSize, const char* content, size_t contentSize)
 {
-    const auto topic_type = std::string(topic, topicSize);
+    static const std::string vehicle_topic(algoTargetTopic);
+    static const std::string event_topic(receivedRadarEventsTopic);
+
+    thread_local v2x::EventInfos eventInfos;
+    thread_local std::vector<std::vector<uint32_t>> routed;
+    thread_local std::vector<size_t> matched;
+
+    const bool is_vehicles = vehicle_topic.compare(0, std::string::npos, topic, topicSize) == 0;
+    const bool is_events = event_topic.compare(0, std::string::npos, topic, topicSize) == 0;
+    if (recorder_ && (is_vehicles || is_events)) {
+        recorder_->append(topic, topicSize, content, contentSize, static_cast<uint16_t>(source));
+    }
+
+    const int64_t received = VirtualClock::now().microSecondsSinceEpoch();
+
+    if (is_vehicles) {
+        // Recycled across frames: the frame vectors and the fallback message keep
+        // their storage, so steady-state ingest does not hit the heap.
+        auto batch = acquire_batch();
+        auto& frame = batch->frame;
+
+        bool parsed = decode_vehicles(content, contentSize, *batch);
+        frame.received = received;
+        ++frames_;
+        VLOG(3) << "participants:" << frame.size();
+
+        if (0 == frames_ % 6000) {
+            const auto stats = ingest_stats();
+            LOG(INFO) << "vehicle frames processed:" << stats.processed << " stale:" << stats.stale
+                      << " superseded:" << stats.superseded << " future:" << stats.future << " age_ms p50:" << stats.age_p50_ms
+                      << " p99:" << stats.age_p99_ms << " max:" << stats.age_max_ms;
+        }
+
+        if (parsed && admit(source, frame)) {
+            // Decoded and projected once here, every context reads the same frame
+            // but only visits the participants inside its own coverage.
+            std::shared_ptr<const VehicleRoutes> routes;
+            {
+                std::lock_guard<std::mutex> lock(routes_mutex_);
+                routes = routes_;
+            }
+
+            routes->grid.route(frame, routed);
+            focus_index_.match(frame, matched);
+            matched.resize(routes->callbacks.size(), FocusIndex::npos);
 
-    v2x::ParticipantInfos participantInfos;
-    if (topic_type == algoTargetTopic && participantInfos.ParseFromArray(content, contentSize)) {
-        vehicle_signal_.call(participantInfos);
+            for (size_t c = 0; c < routes->callbacks.size(); ++c) {
+                auto& indices = routed[c];
+                const size_t m = matched[c];
+                if (FocusIndex::npos != m) {
+                    // A target outside the coverage is still delivered so the context can let go of it.
+                    auto pos = std::lower_bound(indices.begin(), indices.end(), m);
+                    if (pos == indices.end() || *pos != m) {
+                        indices.insert(pos, static_cast<uint32_t>(m));
+                    }
+                }
+                if (!indices.empty()) {
+                    routes->callbacks[c](batch, indices, m);
+                }
+            }
+        }
     }
 
-    v2x::EventInfos eventInfos;
-    if (topic_type == receivedRadarEventsTopic && eventInfos.ParseFromArray(content, contentSize)) {
+    if (is_events && eventInfos.ParseFromArray(content, contentSize)) {
         event_signal_.call(eventInfos);
     }
 }
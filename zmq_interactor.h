@@ -1,36 +1,101 @@
 #pragma once
 
+#include "camera_grid.h"
+#include "focus_index.h"
+#include "latency_histogram.h"
 #include "mqtt_interactor.h"
+#include "participant_frame.h"
 
 #include <base/SignalSlot.h>
 #include <ihspb/pub-sub.pb.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
 
 namespace afl {
 class SubscriberAbstract;
 }
 
-using VehicleMessageCallback = std::function<void(const v2x::ParticipantInfos&)>;
+namespace capture {
+class Recorder;
+}
+
+// batch: shared read-only, may be kept past the call to hand it to another thread.
+// indices: the participants of batch->frame inside the subscriber's coverage, plus the
+// matched one. matched: the first participant matching the subscriber's focus, or
+// FocusIndex::npos.
+using VehicleMessageCallback = std::function<void(const std::shared_ptr<const ParticipantBatch>& batch, const std::vector<uint32_t>& indices, size_t matched)>;
 using EventMessageCallback = std::function<void(const v2x::EventInfos&)>;
 
 class ZmqInteractor {
 public:
+    // The publishers vehicle frames come from, each read on its own thread.
+    enum Source {
+        ALGO_RESULT = 0,
+        SENSOR,
+        SOURCES
+    };
+
     ZmqInteractor(void);
+    ~ZmqInteractor();
 
     void startZMQ();
 
-    void set_vehicles_callback(VehicleMessageCallback cb);
+    // Only participants within radius of (x, y) or matching the focus are delivered, and
+    // only when there are any. Returns the subscriber id used by set_focus.
+    uint32_t set_vehicles_callback(VehicleMessageCallback cb, double x, double y, double radius);
+    void set_focus(uint32_t subscriber, int type, const std::string& focus);
     void set_evnets_callback(EventMessageCallback cb);
 
+    // Feeds one message in as if the subscriber had received it from source, for replay.
+    void inject(const char* topic, size_t topicSize, const char* content, size_t contentSize, Source source = ALGO_RESULT);
+
+    struct IngestStats {
+        uint64_t processed;
+        uint64_t stale; // older than --max_frame_age_ms when received
+        uint64_t superseded; // older than a frame already routed from the same publisher
+        uint64_t future; // newer than now plus --max_frame_skew_ms, routed but not trusted as a mark
+        int64_t age_p50_ms;
+        int64_t age_p99_ms;
+        int64_t age_max_ms;
+    };
+    IngestStats ingest_stats() const;
+
 private:
-    void onMessageHandler(const char* topic, size_t topicSize, const char* content, size_t contentSize);
+    static std::shared_ptr<ParticipantBatch> acquire_batch();
+    static bool decode_vehicles(const char* content, size_t contentSize, ParticipantBatch& batch);
+    void onMessageHandler(Source source, const char* topic, size_t topicSize, const char* content, size_t contentSize);
+    bool admit(Source source, const ParticipantFrame& frame);
 
 private:
-    std::shared_ptr<afl::SubscriberAbstract> subscriberPtr_ { nullptr };
+    std::vector<std::shared_ptr<afl::SubscriberAbstract>> subscribers_;
+    std::unique_ptr<capture::Recorder> recorder_; // --capture_dir
+
+    struct VehicleRoutes {
+        explicit VehicleRoutes(double cell_size)
+            : grid(cell_size)
+        {
+        }
+
+        CameraGrid grid;
+        std::vector<VehicleMessageCallback> callbacks;
+    };
 
     std::vector<afl::Slot> slots_;
-    afl::Signal<void(const v2x::ParticipantInfos&)> vehicle_signal_;
+    // Copy-on-write: subscribers may register while the reader thread is routing.
+    std::mutex routes_mutex_;
+    std::shared_ptr<const VehicleRoutes> routes_;
+    FocusIndex focus_index_;
     afl::Signal<void(const v2x::EventInfos&)> event_signal_;
+
+    std::atomic<uint64_t> frames_ { 0 };
+
+    uint64_t newest_routed_[SOURCES] = {}; // each only touched by its source's reader thread
+    std::atomic<uint64_t> processed_ { 0 };
+    std::atomic<uint64_t> stale_ { 0 };
+    std::atomic<uint64_t> superseded_ { 0 };
+    std::atomic<uint64_t> future_ { 0 };
+    LatencyHistogram age_;
 };
\ No newline at end of file